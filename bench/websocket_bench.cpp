@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <asio.hpp>
+#include <asio/ssl.hpp>
+
+#include "TcpConnection.hpp"
+#include "WebSocket.hpp"
+#include "EchoServer.hpp"
+#include "TestCertificate.hpp"
+#include "RegisteredBuffers.hpp"
+
+/*
+    Loopback benchmarks against the in-process EchoServer
+    Numbers are only comparable between runs on the same machine; build once
+    with use_io_uring=false and once with use_io_uring=true to compare backends.
+    The `tls` scenario compares userspace TLS with kernel TLS offload against a
+    wss:// EchoServer with a self-signed certificate, or a remote echo server.
+*/
+
+#if defined(ASIO_HAS_IO_URING)
+static const char* backend = "io_uring";
+#else
+static const char* backend = "epoll";
+#endif
+
+using bench_clock = std::chrono::steady_clock;
+
+struct RttResult
+{
+    double mean_us = 0;
+    double p50_us = 0;
+    double p99_us = 0;
+    TlsMode mode = TlsMode::None;
+};
+
+// where run_rtt connects; an empty host means the in-process EchoServer, which
+// speaks wss:// when run_rtt is given a server TLS context
+struct RttTarget
+{
+    std::string host;
+    std::string port;
+    std::string path = "/";
+};
+
+// one masked client frame; without fin the message continues in the next frame
+static std::vector<std::byte> client_frame(ws_opcode opcode, bool fin, const std::string& payload)
+{
+    const std::array<std::byte, 4> mask = {std::byte{0x12}, std::byte{0x34},
+                                           std::byte{0x56}, std::byte{0x78}};
+    std::vector<std::byte> frame(max_frame_header_size + payload.size());
+    std::size_t n = encode_frame_header(frame.data(), opcode, payload.size(), &mask);
+    if (!fin) frame[0] &= std::byte{0x7f};
+    copy_masked(frame.data() + n, reinterpret_cast<const std::byte*>(payload.data()),
+                payload.size(), mask);
+    frame.resize(n + payload.size());
+    return frame;
+}
+
+/*
+    Every round sends one text message as `fragments` frames, each its own write,
+    and waits for the echo, which the server only sends once the final fragment
+    is in. That is a request split over several writes: with Nagle on, the
+    second write waits for the ACK of the first, and the server, with nothing to
+    answer yet, delays that ACK (~40 ms on Linux).
+*/
+static RttResult run_rtt(const SocketOptions& opts, int rounds, int fragments,
+                         const RttTarget& remote = {}, asio::ssl::context* tls = nullptr)
+{
+    asio::io_context io;
+    std::unique_ptr<EchoServer> server;
+    RttTarget target = remote;
+    if (target.host.empty())
+    {
+        server = std::make_unique<EchoServer>(io, tls);
+        target = {"127.0.0.1", server->port(), "/"};
+    }
+    auto work = asio::make_work_guard(io);
+    std::thread io_thread([&]{ io.run(); });
+
+    std::mutex m;
+    std::condition_variable cv;
+    bool open = false;
+    int received = 0;
+
+    const std::string fragment(32, 'x');
+    std::string payload;
+    for (int f = 0; f < fragments; ++f) payload += fragment;
+
+    std::vector<std::vector<std::byte>> frames;
+    for (int f = 0; f < fragments; ++f)
+        frames.push_back(client_frame(f == 0 ? ws_opcode::text : ws_opcode{0},  // continuation
+                                      f == fragments - 1, fragment));
+
+    auto conn = std::make_shared<TcpConnection>(io, target.host, target.port, opts);
+    if (server && tls) trust_test_certificate(*conn);
+    auto ws = std::make_shared<WebSocket>(conn, target.host, target.port, target.path);
+
+    ws->on_open([&]{
+        std::lock_guard<std::mutex> lk(m);
+        open = true;
+        cv.notify_all();
+    });
+    ws->on_message([&](const std::vector<std::byte>& msg){
+        // public echo servers may greet first, only count our own echoes
+        if (msg.size() != payload.size() ||
+            std::memcmp(msg.data(), payload.data(), payload.size()) != 0)
+            return;
+        std::lock_guard<std::mutex> lk(m);
+        ++received;
+        cv.notify_all();
+    });
+    ws->start();
+
+    {
+        std::unique_lock<std::mutex> lk(m);
+        cv.wait(lk, [&]{ return open; });
+    }
+
+    std::vector<double> samples;
+    samples.reserve(rounds);
+
+    for (int r = 0; r < rounds; ++r)
+    {
+        auto start = bench_clock::now();
+        for (const auto& frame : frames)
+            conn->send(frame);
+
+        std::unique_lock<std::mutex> lk(m);
+        cv.wait(lk, [&]{ return received == r + 1; });
+
+        samples.push_back(
+            std::chrono::duration<double, std::micro>(bench_clock::now() - start).count());
+    }
+
+    io.stop();
+    io_thread.join();
+
+    std::sort(samples.begin(), samples.end());
+    RttResult res;
+    for (double s : samples) res.mean_us += s;
+    res.mean_us /= samples.size();
+    res.p50_us = samples[samples.size() / 2];
+    res.p99_us = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+    res.mode = conn->tls_mode();
+    return res;
+}
+
+static void bench_socket_options(int rounds)
+{
+    constexpr int fragments = 2;
+
+    SocketOptions tuned;            // low-latency defaults
+
+    SocketOptions kernel_defaults;
+    kernel_defaults.no_delay = false;
+    kernel_defaults.quick_ack = false;
+    kernel_defaults.keep_alive = false;
+
+    std::printf("[%s] small-message RTT on loopback (one message in %d 32 byte fragments per round, %d rounds)\n",
+                backend, fragments, rounds);
+    std::printf("%-28s %10s %10s %10s\n", "socket options", "mean(us)", "p50(us)", "p99(us)");
+
+    auto report = [](const char* name, const RttResult& r) {
+        std::printf("%-28s %10.1f %10.1f %10.1f\n", name, r.mean_us, r.p50_us, r.p99_us);
+    };
+
+    report("nagle + delayed ack", run_rtt(kernel_defaults, rounds, fragments));
+    report("nodelay + quickack", run_rtt(tuned, rounds, fragments));
+}
+
+// wss:// RTT with userspace TLS vs kernel TLS offload, on loopback unless a
+// remote target is given; the mode column shows what the connection really got
+// (ktls falls back to tls without the `tls` module)
+static void bench_tls(const RttTarget& target, int rounds)
+{
+    constexpr int fragments = 2;
+
+    SocketOptions userspace;
+
+    SocketOptions offload;
+    offload.ktls = true;
+
+    asio::ssl::context tls(asio::ssl::context::tls_server);
+    use_test_certificate(tls);
+
+    std::string where = target.host.empty()
+        ? std::string("loopback")
+        : target.host + ":" + target.port + target.path;
+    std::printf("[%s] small-message RTT to %s (one message in %d 32 byte fragments per round, %d rounds)\n",
+                backend, where.c_str(), fragments, rounds);
+    std::printf("%-28s %-8s %10s %10s %10s\n", "tls", "mode", "mean(us)", "p50(us)", "p99(us)");
+
+    auto report = [](const char* name, const RttResult& r) {
+        std::printf("%-28s %-8s %10.1f %10.1f %10.1f\n", name, tls_mode_name(r.mode),
+                    r.mean_us, r.p50_us, r.p99_us);
+    };
+
+    report("asio ssl stream", run_rtt(userspace, rounds, fragments, target, &tls));
+    report("ktls requested", run_rtt(offload, rounds, fragments, target, &tls));
+}
+
+// `connections` clients each send `messages` small frames back to back on one
+// io thread, returns echoed messages per second
+static double run_throughput(int connections, int messages)
+{
+    asio::io_context io;
+    EchoServer server(io);
+    auto read_buffers = std::make_shared<RegisteredReadBuffers>(io, connections);
+    auto work = asio::make_work_guard(io);
+    std::thread io_thread([&]{ io.run(); });
+
+    const long expected = long(connections) * messages;
+    std::mutex m;
+    std::condition_variable cv;
+    int open = 0;
+    std::atomic<long> received{0};
+
+    std::vector<std::shared_ptr<WebSocket>> sockets;
+    for (int c = 0; c < connections; ++c)
+    {
+        auto conn = std::make_shared<TcpConnection>(io, "127.0.0.1", server.port());
+        conn->use_read_buffers(read_buffers);
+        auto ws = std::make_shared<WebSocket>(conn, "127.0.0.1", server.port(), "/");
+
+        ws->on_open([&]{
+            std::lock_guard<std::mutex> lk(m);
+            ++open;
+            cv.notify_all();
+        });
+        ws->on_message([&](const std::vector<std::byte>&){
+            if (++received == expected) {
+                std::lock_guard<std::mutex> lk(m);
+                cv.notify_all();
+            }
+        });
+        ws->start();
+        sockets.push_back(std::move(ws));
+    }
+
+    {
+        std::unique_lock<std::mutex> lk(m);
+        cv.wait(lk, [&]{ return open == connections; });
+    }
+
+    const std::string payload(32, 'x');
+    auto start = bench_clock::now();
+
+    for (int i = 0; i < messages; ++i)
+        for (auto& ws : sockets)
+            ws->send_text(payload);
+
+    {
+        std::unique_lock<std::mutex> lk(m);
+        cv.wait(lk, [&]{ return received.load() == expected; });
+    }
+
+    double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    io.stop();
+    io_thread.join();
+    return expected / seconds;
+}
+
+static void bench_many_connections(int scale)
+{
+    const int connections = 256;
+    const int messages = std::max(1, scale / 10);
+
+    std::printf("[%s] %d connections x %d messages (32 byte frames)\n",
+                backend, connections, messages);
+    std::printf("  %.0f msg/s\n", run_throughput(connections, messages));
+}
+
+static void bench_message_rate(int scale)
+{
+    const int messages = scale * 50;
+
+    std::printf("[%s] 1 connection x %d messages (32 byte frames)\n", backend, messages);
+    std::printf("  %.0f msg/s\n", run_throughput(1, messages));
+}
+
+int main(int argc, char** argv)
+{
+    // websocket_bench [rtt|connections|rate|all] [scale]
+    // websocket_bench tls [rounds]
+    // websocket_bench tls <host> <port> [path] [rounds]
+    const char* which = argc > 1 ? argv[1] : "all";
+
+    if (std::strcmp(which, "tls") == 0)
+    {
+        RttTarget target;
+        int rounds = argc > 2 ? std::atoi(argv[2]) : 200;
+        if (argc > 3)
+        {
+            target = {argv[2], argv[3], argc > 4 ? argv[4] : "/"};
+            rounds = argc > 5 ? std::atoi(argv[5]) : 200;
+        }
+        bench_tls(target, rounds > 0 ? rounds : 200);
+        return 0;
+    }
+
+    int scale = argc > 2 ? std::atoi(argv[2]) : 2000;
+    if (scale <= 0) scale = 2000;
+
+    bool all = std::strcmp(which, "all") == 0;
+
+    if (all || std::strcmp(which, "rtt") == 0)
+        bench_socket_options(scale);
+    if (all || std::strcmp(which, "connections") == 0)
+        bench_many_connections(scale);
+    if (all || std::strcmp(which, "rate") == 0)
+        bench_message_rate(scale);
+    return 0;
+}
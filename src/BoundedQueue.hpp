@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/*
+    Bounded lock-free queue (Vyukov's array-based MPMC design)
+    Every cell carries a sequence number telling producers and consumers whether
+    it is free or filled for their lap around the ring, so neither side ever
+    takes a lock. Safe for any number of producers and consumers; the dispatcher
+    uses it as an MPSC queue and pops from the producer side to drop the oldest
+    entry on overflow.
+*/
+template <typename T>
+class BoundedQueue
+{
+public:
+    // capacity is rounded up to the next power of two
+    explicit BoundedQueue(std::size_t capacity)
+    {
+        std::size_t size = 2;
+        while (size < capacity) size <<= 1;
+
+        mask_ = size - 1;
+        cells_ = std::make_unique<Cell[]>(size);
+        for (std::size_t i = 0; i < size; ++i)
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // v is only moved from when the push succeeds
+    bool try_push(T& v)
+    {
+        std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+
+        for (;;)
+        {
+            cell = &cells_[pos & mask_];
+            std::size_t seq = cell->seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+
+            if (diff == 0)
+            {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;   // full
+            else
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+
+        cell->value = std::move(v);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& out)
+    {
+        std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+
+        for (;;)
+        {
+            cell = &cells_[pos & mask_];
+            std::size_t seq = cell->seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+
+            if (diff == 0)
+            {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;   // empty
+            else
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+        }
+
+        out = std::move(cell->value);
+        cell->value = T{};
+        cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    // approximate, only meaningful as a hint while producers/consumers are active
+    bool empty() const
+    {
+        return enqueue_pos_.load() == dequeue_pos_.load();
+    }
+
+    // approximate, like empty()
+    bool full() const
+    {
+        return enqueue_pos_.load() - dequeue_pos_.load() >= capacity();
+    }
+
+    std::size_t capacity() const { return mask_ + 1; }
+
+private:
+    struct Cell
+    {
+        std::atomic<std::size_t> seq;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    std::size_t mask_ = 0;
+
+    // producers and consumers hammer different counters, keep them on separate lines
+    alignas(64) std::atomic<std::size_t> enqueue_pos_{0};
+    alignas(64) std::atomic<std::size_t> dequeue_pos_{0};
+};
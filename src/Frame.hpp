@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+enum class ws_opcode : uint8_t {
+    text   = 0x1,
+    binary = 0x2,
+    close  = 0x8,
+    ping   = 0x9,
+    pong   = 0xA
+};
+
+// largest header: 2 bytes + 8 byte length + 4 byte mask
+constexpr std::size_t max_frame_header_size = 14;
+
+// write a FIN frame header for a payload of len bytes into out (at least
+// max_frame_header_size bytes), mask may be null for unmasked frames
+// returns the number of header bytes written
+inline std::size_t encode_frame_header(std::byte* out, ws_opcode opcode, std::size_t len,
+                                       const std::array<std::byte, 4>* mask)
+{
+    std::size_t n = 0;
+    out[n++] = std::byte(0x80 | uint8_t(opcode));
+
+    uint8_t mask_bit = mask ? 0x80 : 0x00;
+
+    if (len <= 125) {
+        out[n++] = std::byte(mask_bit | len);
+    } else if (len <= 65535) {
+        out[n++] = std::byte(mask_bit | 126);
+        out[n++] = std::byte((len >> 8) & 0xff);
+        out[n++] = std::byte(len & 0xff);
+    } else {
+        out[n++] = std::byte(mask_bit | 127);
+        for (int i = 7; i >= 0; --i)
+            out[n++] = std::byte((uint64_t(len) >> (8 * i)) & 0xff);
+    }
+
+    if (mask) {
+        std::memcpy(out + n, mask->data(), 4);
+        n += 4;
+    }
+    return n;
+}
+
+// dst = src ^ the repeating 4 byte mask, 8 bytes at a time; dst may equal src
+inline void copy_masked(std::byte* dst, const std::byte* src, std::size_t size,
+                        const std::array<std::byte, 4>& mask)
+{
+    uint32_t m32;
+    std::memcpy(&m32, mask.data(), 4);
+    const uint64_t m64 = (uint64_t(m32) << 32) | m32;
+
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, src + i, 8);
+        w ^= m64;
+        std::memcpy(dst + i, &w, 8);
+    }
+    for (; i < size; ++i)
+        dst[i] = src[i] ^ mask[i % 4];
+}
+
+// mask data in place
+inline void apply_mask(std::byte* data, std::size_t size, const std::array<std::byte, 4>& mask)
+{
+    copy_masked(data, data, size, mask);
+}
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "BoundedQueue.hpp"
+
+/*
+    What happens when a worker's queue is full. The queue belongs to the worker,
+    not to a connection: every connection pinned to that worker shares it, so
+    the policy acts on whichever connection pushes into the full queue.
+    - Block stalls that connection's strand, and with it everything else on
+      that strand, until the worker frees a slot.
+    - DropOldest discards the oldest queued message, which may belong to a
+      different connection than the one pushing.
+    - Disconnect tears down the pushing connection, even when another
+      connection filled the queue.
+*/
+enum class OverflowPolicy
+{
+    Block,        // IO thread parks until there is room, backpressure reaches the socket
+    DropOldest,   // oldest queued message, of any connection on the worker, is discarded
+    Disconnect    // push fails, the pushing connection is torn down
+};
+
+struct DispatcherOptions
+{
+    std::size_t queue_capacity = 1024;   // per worker, shared by all its connections
+    std::size_t workers = 1;
+    OverflowPolicy overflow = OverflowPolicy::Block;
+};
+
+struct DispatchStats
+{
+    uint64_t dispatched = 0;
+    uint64_t dropped = 0;           // DropOldest evictions
+    uint64_t rejected = 0;          // Disconnect overflows
+    uint64_t avg_latency_ns = 0;    // time from push to handler start
+    uint64_t max_latency_ns = 0;
+};
+
+/*
+    Runs message handlers on worker threads instead of the IO thread
+    Each worker owns one bounded lock-free queue; a connection is pinned to one
+    worker so its messages keep their order while slow handlers no longer
+    stall reads. Idle workers spin briefly and then park on a condition variable;
+    so do producers waiting for room under OverflowPolicy::Block.
+*/
+class MessageDispatcher
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit MessageDispatcher(DispatcherOptions opts = {})
+        : opts_(opts)
+    {
+        if (opts_.workers == 0) opts_.workers = 1;
+
+        for (std::size_t i = 0; i < opts_.workers; ++i)
+            workers_.push_back(std::make_unique<Worker>(opts_.queue_capacity));
+
+        for (auto& w : workers_)
+            w->thread = std::thread([this, wp = w.get()]{ run(*wp); });
+    }
+
+    ~MessageDispatcher() { stop(); }
+
+    MessageDispatcher(const MessageDispatcher&) = delete;
+    MessageDispatcher& operator=(const MessageDispatcher&) = delete;
+
+    // stop the workers, messages still queued are discarded
+    void stop()
+    {
+        if (stopped_.exchange(true)) return;
+
+        for (auto& w : workers_)
+        {
+            {
+                std::lock_guard<std::mutex> lk(w->m);
+            }
+            w->cv.notify_one();
+            w->room.notify_all();
+        }
+        for (auto& w : workers_)
+            if (w->thread.joinable()) w->thread.join();
+    }
+
+    // pick the worker a new connection is pinned to
+    std::size_t assign_worker()
+    {
+        return next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    }
+
+    // false when the message could not be queued (Disconnect policy or stopped)
+    bool push(std::size_t worker, Task task)
+    {
+        Worker& w = *workers_[worker % workers_.size()];
+        Item item{std::move(task), std::chrono::steady_clock::now()};
+        int spins = 0;
+
+        while (!w.queue.try_push(item))
+        {
+            if (stopped_.load()) return false;
+
+            switch (opts_.overflow)
+            {
+                case OverflowPolicy::Block:
+                    if (++spins < spins_before_park)
+                        std::this_thread::yield();
+                    else
+                        wait_for_room(w);
+                    break;
+
+                case OverflowPolicy::DropOldest:
+                {
+                    Item oldest;
+                    if (w.queue.try_pop(oldest))
+                        dropped_.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                }
+
+                case OverflowPolicy::Disconnect:
+                    rejected_.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+            }
+        }
+
+        // pairs with the store to `sleeping` in run(): either we see the worker
+        // parked, or it sees our message before waiting
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (w.sleeping.load())
+        {
+            {
+                std::lock_guard<std::mutex> lk(w.m);
+            }
+            w.cv.notify_one();
+        }
+        return true;
+    }
+
+    DispatchStats stats() const
+    {
+        DispatchStats s;
+        s.dispatched = dispatched_.load(std::memory_order_relaxed);
+        s.dropped = dropped_.load(std::memory_order_relaxed);
+        s.rejected = rejected_.load(std::memory_order_relaxed);
+        s.max_latency_ns = max_latency_ns_.load(std::memory_order_relaxed);
+        if (s.dispatched)
+            s.avg_latency_ns = total_latency_ns_.load(std::memory_order_relaxed) / s.dispatched;
+        return s;
+    }
+
+private:
+    static constexpr int spins_before_park = 64;
+
+    struct Item
+    {
+        Task task;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    struct Worker
+    {
+        explicit Worker(std::size_t capacity) : queue(capacity) {}
+
+        BoundedQueue<Item> queue;
+        std::thread thread;
+        std::atomic<bool> sleeping{false};
+        std::atomic<int> blocked{0};        // producers parked in wait_for_room()
+        std::mutex m;
+        std::condition_variable cv;         // worker waits for messages
+        std::condition_variable room;       // producers wait for a free slot
+    };
+
+    // park a Block producer until the worker frees a slot or we stop
+    void wait_for_room(Worker& w)
+    {
+        std::unique_lock<std::mutex> lk(w.m);
+        w.blocked.fetch_add(1);
+        // pairs with the fence in run(): either the worker sees us blocked,
+        // or we see the slot it freed
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        w.room.wait(lk, [&]{ return stopped_.load() || !w.queue.full(); });
+        w.blocked.fetch_sub(1);
+    }
+
+    void run(Worker& w)
+    {
+        int idle = 0;
+        Item item;
+
+        while (!stopped_.load())
+        {
+            if (w.queue.try_pop(item))
+            {
+                idle = 0;
+
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (w.blocked.load())
+                {
+                    {
+                        std::lock_guard<std::mutex> lk(w.m);
+                    }
+                    w.room.notify_one();
+                }
+
+                record_latency(std::chrono::steady_clock::now() - item.enqueued);
+                item.task();
+                item.task = nullptr;
+                continue;
+            }
+
+            if (++idle < spins_before_park)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // nothing to do for a while, park until push() wakes us
+            std::unique_lock<std::mutex> lk(w.m);
+            w.sleeping.store(true);
+            w.cv.wait(lk, [&]{ return stopped_.load() || !w.queue.empty(); });
+            w.sleeping.store(false);
+            idle = 0;
+        }
+    }
+
+    void record_latency(std::chrono::steady_clock::duration d)
+    {
+        auto ns = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+
+        dispatched_.fetch_add(1, std::memory_order_relaxed);
+        total_latency_ns_.fetch_add(ns, std::memory_order_relaxed);
+
+        uint64_t prev = max_latency_ns_.load(std::memory_order_relaxed);
+        while (ns > prev &&
+               !max_latency_ns_.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {}
+    }
+
+    DispatcherOptions opts_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<std::size_t> next_worker_{0};
+    std::atomic<bool> stopped_{false};
+
+    std::atomic<uint64_t> dispatched_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> rejected_{0};
+    std::atomic<uint64_t> total_latency_ns_{0};
+    std::atomic<uint64_t> max_latency_ns_{0};
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Frame.hpp"
+
+/*
+    A message encoded once and sent to many connections
+    The unmasked frame (header + payload) lives in one immutable refcounted
+    buffer shared by every send. Unmasked senders put that buffer on the wire
+    as is; masking senders only write a fresh header and a masked copy of the
+    payload per connection, in one pass. Copies of a PreparedMessage are cheap.
+    No extensions are negotiated by this client, so the payload is not compressed.
+*/
+class PreparedMessage
+{
+public:
+    PreparedMessage(ws_opcode opcode, const std::vector<std::byte>& payload)
+        : PreparedMessage(opcode, payload.data(), payload.size()) {}
+
+    static PreparedMessage text(const std::string& s)
+    {
+        return PreparedMessage(ws_opcode::text,
+                               reinterpret_cast<const std::byte*>(s.data()), s.size());
+    }
+
+    static PreparedMessage binary(const std::vector<std::byte>& payload)
+    {
+        return PreparedMessage(ws_opcode::binary, payload);
+    }
+
+    ws_opcode opcode() const { return opcode_; }
+
+    // the whole unmasked frame, ready to be written
+    const std::shared_ptr<const std::vector<std::byte>>& frame() const { return frame_; }
+
+    const std::byte* payload() const { return frame_->data() + header_len_; }
+    std::size_t payload_size() const { return frame_->size() - header_len_; }
+
+private:
+    PreparedMessage(ws_opcode opcode, const std::byte* data, std::size_t size)
+        : opcode_(opcode)
+    {
+        auto frame = std::make_shared<std::vector<std::byte>>(max_frame_header_size + size);
+        header_len_ = encode_frame_header(frame->data(), opcode, size, nullptr);
+        if (size)
+            std::memcpy(frame->data() + header_len_, data, size);
+        frame->resize(header_len_ + size);
+        frame_ = std::move(frame);
+    }
+
+    ws_opcode opcode_;
+    std::size_t header_len_ = 0;
+    std::shared_ptr<const std::vector<std::byte>> frame_;
+};
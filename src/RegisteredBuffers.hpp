@@ -0,0 +1,93 @@
+#pragma once
+
+#include <asio.hpp>
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// registered buffers arrived with asio 1.22; older releases have no io_uring backend at all
+#if defined(ASIO_HAS_IO_URING) && defined(ASIO_VERSION) && ASIO_VERSION < 102200
+#error "use_io_uring needs asio 1.22 or newer"
+#endif
+
+/*
+    Fixed pool of read buffers shared by the connections of one io_context
+    With the io_uring backend (ASIO_HAS_IO_URING) the whole pool is registered
+    with the ring once, so plain-TCP reads go out as IORING_OP_READ_FIXED and the
+    kernel skips pinning/mapping the pages on every read. Other backends get the
+    same pool unregistered. Only one registration may exist per io_context.
+    TLS reads go through the ssl stream's own buffers and do not use the pool.
+*/
+class RegisteredReadBuffers
+{
+public:
+    static constexpr std::size_t buffer_size = 4096;
+
+    RegisteredReadBuffers(asio::io_context& io, std::size_t count)
+        : storage_(count),
+          free_slots_(make_free_list(count))
+#if defined(ASIO_HAS_IO_URING)
+          , registration_(asio::register_buffers(io, make_sequence(storage_)))
+#endif
+    {
+        (void)io;
+    }
+
+    RegisteredReadBuffers(const RegisteredReadBuffers&) = delete;
+    RegisteredReadBuffers& operator=(const RegisteredReadBuffers&) = delete;
+
+    // claim a slot for one connection, -1 when the pool is exhausted
+    int acquire()
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        if (free_slots_.empty()) return -1;
+        int slot = free_slots_.back();
+        free_slots_.pop_back();
+        return slot;
+    }
+
+    void release(int slot)
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        free_slots_.push_back(slot);
+    }
+
+    std::byte* data(int slot) { return storage_[slot].data(); }
+
+#if defined(ASIO_HAS_IO_URING)
+    asio::mutable_registered_buffer buffer(int slot) { return registration_[slot]; }
+#else
+    asio::mutable_buffer buffer(int slot) { return asio::buffer(storage_[slot]); }
+#endif
+
+private:
+    using Block = std::array<std::byte, buffer_size>;
+
+    static std::vector<int> make_free_list(std::size_t count)
+    {
+        std::vector<int> slots;
+        slots.reserve(count);
+        for (std::size_t i = count; i > 0; --i)
+            slots.push_back(static_cast<int>(i - 1));
+        return slots;
+    }
+
+    static std::vector<asio::mutable_buffer> make_sequence(std::vector<Block>& storage)
+    {
+        std::vector<asio::mutable_buffer> seq;
+        seq.reserve(storage.size());
+        for (auto& b : storage)
+            seq.push_back(asio::buffer(b));
+        return seq;
+    }
+
+    std::vector<Block> storage_;
+    std::mutex m_;
+    std::vector<int> free_slots_;
+
+#if defined(ASIO_HAS_IO_URING)
+    asio::buffer_registration<std::vector<asio::mutable_buffer>> registration_;
+#endif
+};
@@ -8,9 +8,121 @@
 #include <array>
 #include <memory>
 #include <vector>
+#include <deque>
+#include "RegisteredBuffers.hpp"
+
+#if defined(__linux__)
+#include <cerrno>
+#include <climits>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+// kernel TLS needs Linux and an OpenSSL 3 built with KTLS support
+#if defined(__linux__) && OPENSSL_VERSION_NUMBER >= 0x30000000L && \
+    defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+#define TCP_CONNECTION_HAS_KTLS 1
+#include <cerrno>
+#include <csignal>
+#include <pthread.h>
+#endif
+
+// how the bytes of a connection are protected
+enum class TlsMode
+{
+    None,        // plain TCP
+    Userspace,   // OpenSSL encrypts and decrypts
+    KtlsTx,      // kernel encrypts, OpenSSL decrypts
+    KtlsRx,      // OpenSSL encrypts, kernel decrypts
+    Ktls         // kernel does both directions
+};
+
+inline const char* tls_mode_name(TlsMode m)
+{
+    switch (m)
+    {
+        case TlsMode::None:      return "plain";
+        case TlsMode::Userspace: return "tls";
+        case TlsMode::KtlsTx:    return "ktls-tx";
+        case TlsMode::KtlsRx:    return "ktls-rx";
+        case TlsMode::Ktls:      return "ktls";
+    }
+    return "unknown";
+}
+
+// plain TCP, or TLS whose records the kernel builds: a connection in this mode
+// writes frames (and gather batches) to the socket as they are; otherwise they
+// go through the userspace TLS encoder and send_gather flattens the batch first
+inline bool tls_mode_writes_raw(TlsMode m)
+{
+    return m == TlsMode::None || m == TlsMode::KtlsTx || m == TlsMode::Ktls;
+}
 
 using asio::ip::tcp;
 
+// applied to the socket right after every successful connect
+struct SocketOptions
+{
+    bool no_delay = true;             // TCP_NODELAY, don't hold small frames back for Nagle
+    int receive_buffer_size = 0;      // SO_RCVBUF, 0 keeps the kernel default
+    int send_buffer_size = 0;         // SO_SNDBUF, 0 keeps the kernel default
+    int busy_poll_us = 0;             // SO_BUSY_POLL (Linux), 0 disables
+    bool quick_ack = true;            // TCP_QUICKACK (Linux), re-armed after every read
+    bool keep_alive = true;           // SO_KEEPALIVE
+    int keep_alive_idle_s = 30;       // TCP_KEEPIDLE (Linux)
+    int keep_alive_interval_s = 10;   // TCP_KEEPINTVL (Linux)
+    int keep_alive_count = 3;         // TCP_KEEPCNT (Linux)
+    bool ktls = false;                // kernel TLS offload for wss:// (Linux + OpenSSL 3), falls
+                                      // back to userspace TLS when the `tls` module is unavailable
+};
+
+/*
+    Several frames submitted as one scatter/gather write
+    `buffers` points into `headers` (one arena for all frame headers), `payloads`
+    and the immutable buffers kept alive by `shared`; the owning vectors must not
+    be resized once `buffers` is filled in
+*/
+struct GatherWrite
+{
+    std::vector<std::byte> headers;
+    std::vector<std::vector<std::byte>> payloads;
+    std::vector<std::shared_ptr<const void>> shared;
+    std::vector<asio::const_buffer> buffers;
+};
+
+#if defined(__linux__)
+// asio passes at most 16 buffers to each write_some, so on Linux gather writes
+// go to sendmsg directly, with as many buffers as the kernel takes per call
+constexpr std::size_t max_gather_buffers = IOV_MAX;
+
+// describe what is left of `buffers` after the first `offset` bytes in at most
+// `max` iovecs, returns how many were filled in
+inline std::size_t gather_iovecs(const std::vector<asio::const_buffer>& buffers,
+                                 std::size_t offset, iovec* iov, std::size_t max)
+{
+    std::size_t count = 0;
+    for (const auto& b : buffers)
+    {
+        if (count == max) break;
+        if (offset >= b.size())
+        {
+            offset -= b.size();
+            continue;
+        }
+        iov[count].iov_base = const_cast<char*>(static_cast<const char*>(b.data()) + offset);
+        iov[count].iov_len = b.size() - offset;
+        offset = 0;
+        ++count;
+    }
+    return count;
+}
+#endif
+
 class TcpConnection : public std::enable_shared_from_this<TcpConnection>
 {
 public:
@@ -25,20 +137,46 @@ public:
 
     TcpConnection(asio::io_context& io,
                   std::string host,
-                  std::string port)
+                  std::string port,
+                  SocketOptions opts = {})
         : io_(io),
           host_(std::move(host)),
           port_(std::move(port)),
+          opts_(opts),
           resolver_(io_),
           socket_(io_),
           ssl_ctx_(asio::ssl::context::tls_client),
           ssl_stream_(socket_, ssl_ctx_),
-          write_strand_(asio::make_strand(io_))  // strand initialized here
+          strand_(asio::make_strand(io_))  // every handler of this connection runs here
     {
         ssl_ctx_.set_default_verify_paths();
         ssl_ctx_.set_verify_mode(asio::ssl::verify_peer);
     }
 
+    virtual ~TcpConnection()
+    {
+        if (read_slot_ >= 0) read_pool_->release(read_slot_);
+        if (native_ssl_) SSL_free(native_ssl_);
+    }
+
+    // valid once on_connect has fired
+    TlsMode tls_mode() const { return tls_mode_; }
+
+    // trust anchors, client certificates etc. for wss://, used by both TLS paths;
+    // call before start()
+    asio::ssl::context& ssl_context() { return ssl_ctx_; }
+
+    // read plain-TCP data into a slot of a shared (io_uring registered) pool,
+    // call before start(); falls back to the connection's own buffer when the pool is full
+    void use_read_buffers(std::shared_ptr<RegisteredReadBuffers> pool)
+    {
+        if (read_slot_ >= 0) read_pool_->release(read_slot_);
+        read_pool_ = std::move(pool);
+        read_slot_ = read_pool_ ? read_pool_->acquire() : -1;
+    }
+
+    asio::io_context& context() { return io_; }
+
     void on_data(DataHandler h)       { on_data_ = std::move(h); }
     void on_error(ErrorHandler h)     { on_error_ = std::move(h); }
     void on_connect(ConnectHandler h) { on_connect_ = std::move(h); }
@@ -47,38 +185,81 @@ public:
     {
         // Resolve host:port and attempt secure connection
         auto self = shared_from_this();
-        resolver_.async_resolve(host_, port_,
-            [this, self](const asio::error_code& ec,
-                         const tcp::resolver::results_type& endpoints)
-            {
-                if (ec) return fail(ec);
-                try_secure_connect(endpoints);
-            });
+        asio::post(strand_, [this, self]
+        {
+            resolver_.async_resolve(host_, port_,
+                asio::bind_executor(strand_,
+                    [this, self](const asio::error_code& ec,
+                                 const tcp::resolver::results_type& endpoints)
+                    {
+                        if (ec) return fail(ec);
+                        try_secure_connect(endpoints);
+                    }));
+        });
     }
 
     virtual void send(std::vector<std::byte> data) // void* data, size_t
     {
         auto self = shared_from_this();
 
-        asio::post(write_strand_,
+        asio::post(strand_,
             [this, self, data = std::move(data)]() mutable
             {
-                auto buffer = asio::buffer(data);
+                // only one async_write may be in flight per stream, queue the rest
+                write_queue_.push_back(Outbound{std::move(data), nullptr});
+                if (write_queue_.size() == 1)
+                    do_write();
+            });
+    }
 
-                auto handler =
-                    [this, self, data = std::move(data)]
-                    (const asio::error_code& ec, std::size_t)
-                    {
-                        if (ec) fail(ec);
-                    };
+    // send a whole batch with one strand hop and, on Linux, one sendmsg per
+    // max_gather_buffers buffers
+    virtual void send_gather(std::shared_ptr<GatherWrite> batch)
+    {
+        auto self = shared_from_this();
 
-                if (use_ssl_)
-                    asio::async_write(ssl_stream_, buffer, handler);
+        asio::post(strand_,
+            [this, self, batch = std::move(batch)]() mutable
+            {
+                // asio's ssl stream encrypts one buffer per write_some, i.e. one record
+                // and one syscall per buffer; flatten so the batch stays a single write
+                if (!raw_writes())
+                {
+                    std::vector<std::byte> flat;
+                    flat.reserve(asio::buffer_size(batch->buffers));
+                    for (const auto& b : batch->buffers)
+                    {
+                        auto* p = static_cast<const std::byte*>(b.data());
+                        flat.insert(flat.end(), p, p + b.size());
+                    }
+                    write_queue_.push_back(Outbound{std::move(flat), nullptr});
+                }
                 else
-                    asio::async_write(socket_, buffer, handler);
+                    write_queue_.push_back(Outbound{{}, std::move(batch)});
+
+                if (write_queue_.size() == 1)
+                    do_write();
             });
     }
 
+    // tear the connection down, pending reads complete with an error
+    virtual void close()
+    {
+        auto self = shared_from_this();
+        asio::post(strand_, [this, self]
+        {
+            asio::error_code ignored;
+            socket_.shutdown(tcp::socket::shutdown_both, ignored);
+            socket_.close(ignored);
+        });
+    }
+
+    // run f on this connection's strand, inline if we are already on it
+    virtual void dispatch(std::function<void()> f)
+    {
+        asio::dispatch(strand_, std::move(f));
+    }
+
 protected:
     DataHandler on_data_;
     ErrorHandler on_error_;
@@ -92,32 +273,41 @@ private:
         auto self = shared_from_this();
 
         asio::async_connect(socket_, endpoints,
-            [this, self, endpoints](const asio::error_code& ec, const tcp::endpoint&)
-            {
-                if (ec) return fail(ec);
-
-                if (!SSL_set_tlsext_host_name(
-                        ssl_stream_.native_handle(), host_.c_str()))
+            asio::bind_executor(strand_,
+                [this, self, endpoints](const asio::error_code& ec, const tcp::endpoint&)
                 {
-                    socket_.close();
-                    return try_plain_connect(endpoints);
-                }
+                    if (ec) return fail(ec);
 
-                ssl_stream_.async_handshake(
-                    asio::ssl::stream_base::client,
-                    [this, self, endpoints](const asio::error_code& ec)
+                    apply_socket_options();
+
+#if defined(TCP_CONNECTION_HAS_KTLS)
+                    if (opts_.ktls) return start_native_tls(endpoints);
+#endif
+
+                    if (!SSL_set_tlsext_host_name(
+                            ssl_stream_.native_handle(), host_.c_str()))
                     {
-                        if (ec)
-                        {
-                            socket_.close();
-                            return try_plain_connect(endpoints);
-                        }
-
-                        use_ssl_ = true;
-                        if (on_connect_) on_connect_(true);
-                        start_read();
-                    });
-            });
+                        socket_.close();
+                        return try_plain_connect(endpoints);
+                    }
+
+                    ssl_stream_.async_handshake(
+                        asio::ssl::stream_base::client,
+                        asio::bind_executor(strand_,
+                            [this, self, endpoints](const asio::error_code& ec)
+                            {
+                                if (ec)
+                                {
+                                    socket_.close();
+                                    return try_plain_connect(endpoints);
+                                }
+
+                                use_ssl_ = true;
+                                tls_mode_ = TlsMode::Userspace;
+                                if (on_connect_) on_connect_(true);
+                                start_read();
+                            }));
+                }));
     }
 
     // start connection and start listening data
@@ -126,40 +316,501 @@ private:
         auto self = shared_from_this();
 
         asio::async_connect(socket_, endpoints,
-            [this, self](const asio::error_code& ec, const tcp::endpoint&)
+            asio::bind_executor(strand_,
+                [this, self](const asio::error_code& ec, const tcp::endpoint&)
+                {
+                    if (ec) return fail(ec);
+
+                    apply_socket_options();
+
+                    use_ssl_ = false;
+                    tls_mode_ = TlsMode::None;
+                    if (on_connect_) on_connect_(false);
+                    start_read();
+                }));
+    }
+
+#if defined(TCP_CONNECTION_HAS_KTLS)
+    /*
+        kTLS path: asio's ssl stream talks to OpenSSL through a memory BIO, which
+        can never hand keys to the kernel, so here OpenSSL owns the socket fd
+        directly and asio only waits for readiness. After the handshake OpenSSL
+        has installed whatever directions the kernel accepted; with kTLS TX our
+        writes go straight to the socket (gather writes included), reads always
+        go through SSL_read, which handles non-data records for kTLS RX.
+        OpenSSL reads the fd with a plain socket BIO and writes it through
+        nosignal_bio, which sends with MSG_NOSIGNAL like asio does.
+    */
+    void start_native_tls(const tcp::resolver::results_type& endpoints)
+    {
+        native_ssl_ = SSL_new(ssl_ctx_.native_handle());
+        if (!native_ssl_ ||
+            !SSL_set_tlsext_host_name(native_ssl_, host_.c_str()))
+            return native_tls_failed(endpoints);
+
+        BIO* rbio = BIO_new_socket(static_cast<int>(socket_.native_handle()), BIO_NOCLOSE);
+        BIO* wbio = rbio ? BIO_new(nosignal_bio()) : nullptr;
+        if (!wbio)
+        {
+            BIO_free(rbio);
+            return native_tls_failed(endpoints);
+        }
+        // the socket BIO is both the rbio and the next of wbio, one reference each
+        BIO_push(wbio, rbio);
+        BIO_up_ref(rbio);
+        SSL_set_bio(native_ssl_, rbio, wbio);
+
+        SSL_set_options(native_ssl_, SSL_OP_ENABLE_KTLS);
+        SSL_set_mode(native_ssl_, SSL_MODE_ENABLE_PARTIAL_WRITE |
+                                  SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+        SSL_set_connect_state(native_ssl_);
+
+        asio::error_code ignored;
+        socket_.non_blocking(true, ignored);
+
+        native_handshake(endpoints);
+    }
+
+    void native_handshake(const tcp::resolver::results_type& endpoints)
+    {
+        auto self = shared_from_this();
+
+        int r = SSL_do_handshake(native_ssl_);
+        if (r == 1)
+        {
+            bool tx = BIO_get_ktls_send(SSL_get_wbio(native_ssl_));
+            bool rx = BIO_get_ktls_recv(SSL_get_rbio(native_ssl_));
+            tls_mode_ = tx && rx ? TlsMode::Ktls
+                      : tx       ? TlsMode::KtlsTx
+                      : rx       ? TlsMode::KtlsRx
+                                 : TlsMode::Userspace;
+
+            // decrypting in userspace, let one read(2) pull in every record that has
+            // arrived; set only now, reading ahead during the handshake could swallow
+            // records the kernel was meant to decrypt
+            if (!kernel_reads()) SSL_set_read_ahead(native_ssl_, 1);
+
+            use_ssl_ = true;
+            if (on_connect_) on_connect_(true);
+            return start_read();
+        }
+
+        int err = SSL_get_error(native_ssl_, r);
+        if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE)
+            return native_tls_failed(endpoints);
+
+        socket_.async_wait(
+            err == SSL_ERROR_WANT_READ ? tcp::socket::wait_read : tcp::socket::wait_write,
+            asio::bind_executor(strand_,
+                [this, self, endpoints](const asio::error_code& ec)
+                {
+                    if (ec) return native_tls_failed(endpoints);
+                    native_handshake(endpoints);
+                }));
+    }
+
+    // same policy as the userspace handshake: give up on TLS, retry as plain TCP
+    void native_tls_failed(const tcp::resolver::results_type& endpoints)
+    {
+        ERR_clear_error();
+        if (native_ssl_)
+        {
+            SSL_free(native_ssl_);
+            native_ssl_ = nullptr;
+        }
+        socket_.close();
+        try_plain_connect(endpoints);
+    }
+
+    /*
+        OpenSSL's socket BIO writes the fd with write(2), which raises SIGPIPE on
+        a reset peer. This filter sits on top of it as the wbio and sends with
+        MSG_NOSIGNAL instead, so handshakes, SSL_write and the alerts or KeyUpdate
+        replies SSL_read may write need no signal juggling. Controls go through to
+        the socket BIO, which is how OpenSSL finds it to install kTLS keys.
+    */
+    static BIO_METHOD* nosignal_bio()
+    {
+        static BIO_METHOD* method = []
+        {
+            BIO_METHOD* m = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_FILTER, "nosignal");
+            BIO_meth_set_write(m, &nosignal_write);
+            BIO_meth_set_ctrl(m, &nosignal_ctrl);
+            BIO_meth_set_create(m, [](BIO* b) { BIO_set_init(b, 1); return 1; });
+            return m;
+        }();
+        return method;
+    }
+
+    static int nosignal_write(BIO* b, const char* data, int size)
+    {
+        BIO* next = BIO_next(b);
+        BIO_clear_retry_flags(b);
+
+        // once the kernel holds the TX keys OpenSSL only writes control records,
+        // which the socket BIO sends with a cmsg; rare enough to block SIGPIPE
+        if (BIO_get_ktls_send(next))
+        {
+            SigpipeGuard guard;
+            int n = BIO_write(next, data, size);
+            BIO_copy_next_retry(b);
+            return n;
+        }
+
+        ssize_t n = ::send(static_cast<int>(BIO_get_fd(next, nullptr)),
+                           data, static_cast<std::size_t>(size), MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            BIO_set_retry_write(b);
+        return static_cast<int>(n);
+    }
+
+    static long nosignal_ctrl(BIO* b, int cmd, long num, void* ptr)
+    {
+        BIO* next = BIO_next(b);
+        return next ? BIO_ctrl(next, cmd, num, ptr) : 0;
+    }
+
+    // blocks SIGPIPE on this thread and swallows one raised meanwhile; errno
+    // survives for the caller
+    class SigpipeGuard
+    {
+    public:
+        SigpipeGuard()
+        {
+            sigemptyset(&pipe_);
+            sigaddset(&pipe_, SIGPIPE);
+            pthread_sigmask(SIG_BLOCK, &pipe_, &old_);
+        }
+
+        ~SigpipeGuard()
+        {
+            if (sigismember(&old_, SIGPIPE)) return;
+
+            int saved_errno = errno;
+            sigset_t pending;
+            if (sigpending(&pending) == 0 && sigismember(&pending, SIGPIPE))
             {
-                if (ec) return fail(ec);
+                timespec zero{0, 0};
+                sigtimedwait(&pipe_, nullptr, &zero);
+            }
+            pthread_sigmask(SIG_SETMASK, &old_, nullptr);
+            errno = saved_errno;
+        }
+
+        SigpipeGuard(const SigpipeGuard&) = delete;
+        SigpipeGuard& operator=(const SigpipeGuard&) = delete;
+
+    private:
+        sigset_t pipe_;
+        sigset_t old_;
+    };
+
+    // a failed SSL_read/SSL_write as asio's ssl stream would report it
+    static asio::error_code native_error(int err, int sys_errno)
+    {
+        unsigned long e = ERR_get_error();
+        ERR_clear_error();
+
+        if (err == SSL_ERROR_SYSCALL && e == 0)
+        {
+            // nothing read at all is a plain EOF, anything else is a socket error
+            if (sys_errno == 0) return asio::error::eof;
+            return asio::error_code(sys_errno, asio::error::get_system_category());
+        }
+        if (ERR_GET_REASON(e) == SSL_R_UNEXPECTED_EOF_WHILE_READING)
+            return asio::ssl::error::stream_truncated;
+        return asio::error_code(static_cast<int>(e), asio::error::get_ssl_category());
+    }
 
-                use_ssl_ = false;
-                if (on_connect_) on_connect_(false);
-                start_read();
-            });
+    // records native_read hands out before yielding the strand
+    static constexpr int native_reads_per_turn = 16;
+
+    // the kernel decrypts, so each SSL_read is one recvmsg for one record
+    bool kernel_reads() const
+    {
+        return tls_mode_ == TlsMode::KtlsRx || tls_mode_ == TlsMode::Ktls;
+    }
+
+    /*
+        Hand out records without going back to the strand for each one. With
+        userspace RX OpenSSL reads ahead, so once it holds nothing more we wait
+        for the socket rather than issue a read that can only find EAGAIN (asio
+        re-arms readiness on every wait). kTLS RX gets one record per call, so
+        there we keep reading until the kernel runs dry.
+    */
+    void native_read()
+    {
+        auto self = shared_from_this();
+        bool acked = false;
+
+        for (int i = 0; i < native_reads_per_turn; ++i)
+        {
+            errno = 0;
+            int n = SSL_read(native_ssl_, read_buf_.data(), static_cast<int>(read_buf_.size()));
+            int sys_errno = errno;
+            if (n > 0)
+            {
+                if (opts_.quick_ack && !acked)
+                {
+                    set_quick_ack();
+                    acked = true;
+                }
+                if (on_data_) on_data_(read_buf_.data(), static_cast<std::size_t>(n));
+
+                if (!kernel_reads() && !SSL_has_pending(native_ssl_))
+                    return native_wait(tcp::socket::wait_read);
+                continue;
+            }
+
+            int err = SSL_get_error(native_ssl_, n);
+            if (err == SSL_ERROR_WANT_READ) return native_wait(tcp::socket::wait_read);
+            if (err == SSL_ERROR_WANT_WRITE) return native_wait(tcp::socket::wait_write);
+
+            // close_notify, a zero-byte read or a missing close_notify end the
+            // stream quietly, exactly like eof/stream_truncated on the asio path
+            if (err == SSL_ERROR_ZERO_RETURN) return;
+
+            asio::error_code ec = native_error(err, sys_errno);
+            if (ec == asio::error::eof || ec == asio::ssl::error::stream_truncated) return;
+            return fail(ec);
+        }
+
+        // a long burst, let the rest of the strand run before going on
+        asio::post(strand_, [this, self]{ native_read(); });
+    }
+
+    void native_wait(tcp::socket::wait_type type)
+    {
+        auto self = shared_from_this();
+
+        socket_.async_wait(type,
+            asio::bind_executor(strand_,
+                [this, self](const asio::error_code& ec)
+                {
+                    if (ec == asio::error::operation_aborted) return;
+                    if (ec) return fail(ec);
+                    native_read();
+                }));
+    }
+
+    // userspace TLS on the native SSL: write the front of write_queue_ with SSL_write
+    void native_write()
+    {
+        auto self = shared_from_this();
+
+        while (!write_queue_.empty())
+        {
+            Outbound& out = write_queue_.front();
+
+            errno = 0;
+            int n = SSL_write(native_ssl_, out.data.data() + write_offset_,
+                              static_cast<int>(out.data.size() - write_offset_));
+            int sys_errno = errno;
+            if (n > 0)
+            {
+                write_offset_ += static_cast<std::size_t>(n);
+                if (write_offset_ == out.data.size())
+                {
+                    write_offset_ = 0;
+                    write_queue_.pop_front();
+                }
+                continue;
+            }
+
+            int err = SSL_get_error(native_ssl_, n);
+            if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+            {
+                socket_.async_wait(
+                    err == SSL_ERROR_WANT_READ ? tcp::socket::wait_read : tcp::socket::wait_write,
+                    asio::bind_executor(strand_,
+                        [this, self](const asio::error_code& ec)
+                        {
+                            if (ec) return write_failed(ec);
+                            native_write();
+                        }));
+                return;
+            }
+
+            return write_failed(native_error(err, sys_errno));
+        }
+    }
+#endif
+
+#if defined(__linux__)
+    // write the gather batch at the front of write_queue_ with sendmsg, which
+    // takes MSG_NOSIGNAL like asio does; wait for room when the socket is full
+    void gather_write()
+    {
+        auto self = shared_from_this();
+        const GatherWrite& batch = *write_queue_.front().gather;
+
+        if (!socket_.non_blocking())
+        {
+            asio::error_code ec;
+            socket_.non_blocking(true, ec);
+            if (ec) return write_failed(ec);
+        }
+
+        std::array<iovec, max_gather_buffers> iov;
+        for (;;)
+        {
+            msghdr msg{};
+            msg.msg_iov = iov.data();
+            msg.msg_iovlen = gather_iovecs(batch.buffers, write_offset_, iov.data(), iov.size());
+            if (msg.msg_iovlen == 0) break;
+
+            ssize_t n = ::sendmsg(static_cast<int>(socket_.native_handle()), &msg, MSG_NOSIGNAL);
+            if (n >= 0)
+            {
+                write_offset_ += static_cast<std::size_t>(n);
+                continue;
+            }
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                socket_.async_wait(tcp::socket::wait_write,
+                    asio::bind_executor(strand_,
+                        [this, self](const asio::error_code& ec)
+                        {
+                            if (ec) return write_failed(ec);
+                            gather_write();
+                        }));
+                return;
+            }
+            return write_failed(asio::error_code(errno, asio::error::get_system_category()));
+        }
+
+        write_offset_ = 0;
+        write_queue_.pop_front();
+        if (!write_queue_.empty())
+            do_write();
+    }
+#endif
+
+    bool raw_writes() const { return tls_mode_writes_raw(tls_mode_); }
+
+    // drop everything queued, including the part of a message already written
+    void write_failed(const asio::error_code& ec)
+    {
+        write_queue_.clear();
+        write_offset_ = 0;
+        fail(ec);
     }
 
     void start_read()
     {
+#if defined(TCP_CONNECTION_HAS_KTLS)
+        if (native_ssl_) return native_read();
+#endif
+
         auto self = shared_from_this();
-        auto buf = std::make_shared<std::array<std::byte, 4096>>();
 
-        auto handler =
-            [this, self, buf](const asio::error_code& ec, std::size_t n)
+        // reads never overlap, so one buffer per connection is enough
+        const bool pooled = !use_ssl_ && read_slot_ >= 0;
+        std::byte* data = pooled ? read_pool_->data(read_slot_) : read_buf_.data();
+
+        auto handler = asio::bind_executor(strand_,
+            [this, self, data](const asio::error_code& ec, std::size_t n)
             {
                 if (ec == asio::error::eof ||
-                    ec == asio::ssl::error::stream_truncated)
+                    ec == asio::ssl::error::stream_truncated ||
+                    ec == asio::error::operation_aborted)
                     return;
 
                 if (ec) return fail(ec);
 
+                // the kernel drops back to delayed ACKs on its own, re-arm
+                if (opts_.quick_ack) set_quick_ack();
+
                 if (on_data_)
-                    on_data_(buf->data(), n);
+                    on_data_(data, n);
 
                 start_read();
-            };
+            });
 
         if (use_ssl_)
-            ssl_stream_.async_read_some(asio::buffer(*buf), handler);
+            ssl_stream_.async_read_some(asio::buffer(read_buf_), handler);
+        else if (pooled)
+            socket_.async_read_some(read_pool_->buffer(read_slot_), handler);
         else
-            socket_.async_read_some(asio::buffer(*buf), handler);
+            socket_.async_read_some(asio::buffer(read_buf_), handler);
+    }
+
+    // socket options are best effort, a kernel that refuses one still gets a working connection
+    void apply_socket_options()
+    {
+        asio::error_code ignored;
+
+        socket_.set_option(tcp::no_delay(opts_.no_delay), ignored);
+
+        if (opts_.receive_buffer_size > 0)
+            socket_.set_option(asio::socket_base::receive_buffer_size(opts_.receive_buffer_size), ignored);
+        if (opts_.send_buffer_size > 0)
+            socket_.set_option(asio::socket_base::send_buffer_size(opts_.send_buffer_size), ignored);
+
+        socket_.set_option(asio::socket_base::keep_alive(opts_.keep_alive), ignored);
+
+#if defined(__linux__)
+        using keep_idle = asio::detail::socket_option::integer<IPPROTO_TCP, TCP_KEEPIDLE>;
+        using keep_interval = asio::detail::socket_option::integer<IPPROTO_TCP, TCP_KEEPINTVL>;
+        using keep_count = asio::detail::socket_option::integer<IPPROTO_TCP, TCP_KEEPCNT>;
+
+        if (opts_.keep_alive)
+        {
+            socket_.set_option(keep_idle(opts_.keep_alive_idle_s), ignored);
+            socket_.set_option(keep_interval(opts_.keep_alive_interval_s), ignored);
+            socket_.set_option(keep_count(opts_.keep_alive_count), ignored);
+        }
+
+#if defined(SO_BUSY_POLL)
+        using busy_poll = asio::detail::socket_option::integer<SOL_SOCKET, SO_BUSY_POLL>;
+        if (opts_.busy_poll_us > 0)
+            socket_.set_option(busy_poll(opts_.busy_poll_us), ignored);
+#endif
+#endif
+
+        if (opts_.quick_ack) set_quick_ack();
+    }
+
+    void set_quick_ack()
+    {
+#if defined(__linux__)
+        using quick_ack = asio::detail::socket_option::boolean<IPPROTO_TCP, TCP_QUICKACK>;
+        asio::error_code ignored;
+        socket_.set_option(quick_ack(true), ignored);
+#endif
+    }
+
+    // write the front of write_queue_, then move on to the next one
+    void do_write()
+    {
+#if defined(TCP_CONNECTION_HAS_KTLS)
+        if (native_ssl_ && !raw_writes()) return native_write();
+#endif
+
+        auto self = shared_from_this();
+        const Outbound& out = write_queue_.front();
+
+#if defined(__linux__)
+        if (out.gather) return gather_write();
+#endif
+
+        auto handler = asio::bind_executor(strand_,
+            [this, self](const asio::error_code& ec, std::size_t)
+            {
+                if (ec) return write_failed(ec);
+
+                write_queue_.pop_front();
+                if (!write_queue_.empty())
+                    do_write();
+            });
+
+        if (out.gather)
+            asio::async_write(socket_, out.gather->buffers, handler);
+        else if (use_ssl_ && !raw_writes())
+            asio::async_write(ssl_stream_, asio::buffer(out.data), handler);
+        else
+            asio::async_write(socket_, asio::buffer(out.data), handler);
     }
 
     void fail(const asio::error_code& ec)
@@ -170,6 +821,7 @@ private:
     asio::io_context& io_;
     std::string host_;
     std::string port_;
+    SocketOptions opts_;
 
     tcp::resolver resolver_;
     tcp::socket socket_;
@@ -177,7 +829,28 @@ private:
     asio::ssl::context ssl_ctx_;
     asio::ssl::stream<tcp::socket&> ssl_stream_;
 
-    asio::strand<asio::io_context::executor_type> write_strand_;  // strand protects send()
+    // resolve/connect/handshake, reads, writes and the upper layer's state all run on
+    // this strand, so one io_context can be driven by several threads
+    asio::strand<asio::io_context::executor_type> strand_;
+
+    // either an owned buffer or a gather batch (plain TCP only)
+    struct Outbound
+    {
+        std::vector<std::byte> data;
+        std::shared_ptr<GatherWrite> gather;
+    };
+    std::deque<Outbound> write_queue_;
+
+    std::array<std::byte, RegisteredReadBuffers::buffer_size> read_buf_;
+    std::shared_ptr<RegisteredReadBuffers> read_pool_;
+    int read_slot_ = -1;
 
     bool use_ssl_{false};
+    TlsMode tls_mode_{TlsMode::None};
+
+    // OpenSSL session bound straight to the socket, only on the kTLS path
+    SSL* native_ssl_{nullptr};
+
+    // bytes of the front of write_queue_ already out, for native_write and gather_write
+    std::size_t write_offset_{0};
 };
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class TimerWheel;
+
+// one armed timeout, owned by the wheel until it fires or is cancelled
+struct TimerEntry
+{
+    std::function<void()> callback;
+    std::size_t slot = 0;
+    std::size_t rounds = 0;     // full turns of the wheel still to wait
+    bool armed = false;
+    std::list<std::shared_ptr<TimerEntry>>::iterator pos;
+};
+
+using TimerHandle = std::shared_ptr<TimerEntry>;
+
+/*
+    Hashed timer wheel shared by every connection of an io_context
+    A single steady_timer ticks at `resolution` and advances a cursor over
+    `slot_count` buckets; timeouts hash into the bucket they expire in (plus a
+    round count for delays longer than one turn), so arming and cancelling are
+    O(1) no matter how many connections there are. The ticker only runs while
+    something is armed, an idle wheel keeps no work on the io_context.
+    Callbacks run on whichever io thread drives the tick, outside the wheel's
+    lock; post to your own strand from them.
+*/
+class TimerWheel : public asio::execution_context::service
+{
+public:
+    static inline asio::execution_context::id id;
+
+    static constexpr std::chrono::milliseconds resolution{100};
+    static constexpr std::size_t slot_count = 512;
+
+    explicit TimerWheel(asio::io_context& io)
+        : asio::execution_context::service(io),
+          timer_(std::make_unique<asio::steady_timer>(io)),
+          slots_(slot_count)
+    {
+    }
+
+    // the wheel of this io_context, created on first use
+    static TimerWheel& of(asio::io_context& io)
+    {
+        return asio::use_service<TimerWheel>(io);
+    }
+
+    // call cb once, `delay` from now (rounded up to the wheel's resolution)
+    TimerHandle arm(std::chrono::milliseconds delay, std::function<void()> cb)
+    {
+        auto entry = std::make_shared<TimerEntry>();
+        entry->callback = std::move(cb);
+
+        std::size_t ticks = to_ticks(delay);
+
+        std::lock_guard<std::mutex> lk(m_);
+        entry->slot = (cursor_ + ticks) % slot_count;
+        entry->rounds = (ticks - 1) / slot_count;
+        entry->armed = true;
+
+        auto& bucket = slots_[entry->slot];
+        entry->pos = bucket.insert(bucket.end(), entry);
+        ++armed_count_;
+
+        if (!ticking_) start_ticking();
+        return entry;
+    }
+
+    // no-op for an empty, fired or already cancelled handle
+    void cancel(const TimerHandle& h)
+    {
+        if (!h) return;
+
+        std::lock_guard<std::mutex> lk(m_);
+        if (!h->armed) return;
+
+        h->armed = false;
+        slots_[h->slot].erase(h->pos);
+        --armed_count_;
+    }
+
+    // ticks since the wheel was created, a cheap coarse clock for activity stamps
+    uint64_t now() const { return ticks_.load(std::memory_order_relaxed); }
+
+    static std::size_t to_ticks(std::chrono::milliseconds d)
+    {
+        auto t = static_cast<std::size_t>((d.count() + resolution.count() - 1) / resolution.count());
+        return t == 0 ? 1 : t;
+    }
+
+    // move the cursor and fire what expired; driven by the internal ticker,
+    // public so tests can step the wheel deterministically
+    void advance(std::size_t ticks = 1)
+    {
+        std::vector<std::shared_ptr<TimerEntry>> fired;
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            collect(ticks, fired);
+        }
+        for (auto& e : fired)
+        {
+            e->callback();
+            e->callback = nullptr;
+        }
+    }
+
+private:
+    void shutdown() override
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        for (auto& bucket : slots_)
+        {
+            for (auto& e : bucket) e->armed = false;
+            bucket.clear();
+        }
+        armed_count_ = 0;
+        // the timer must go before the timer service it belongs to is destroyed
+        timer_.reset();
+    }
+
+    // under m_
+    void collect(std::size_t ticks, std::vector<std::shared_ptr<TimerEntry>>& fired)
+    {
+        for (std::size_t t = 0; t < ticks; ++t)
+        {
+            cursor_ = (cursor_ + 1) % slot_count;
+            ticks_.fetch_add(1, std::memory_order_relaxed);
+
+            auto& bucket = slots_[cursor_];
+            for (auto it = bucket.begin(); it != bucket.end();)
+            {
+                auto& e = *it;
+                if (e->rounds > 0)
+                {
+                    --e->rounds;
+                    ++it;
+                    continue;
+                }
+                e->armed = false;
+                fired.push_back(std::move(e));
+                it = bucket.erase(it);
+                --armed_count_;
+            }
+        }
+    }
+
+    // under m_
+    void start_ticking()
+    {
+        if (!timer_) return;
+
+        ticking_ = true;
+        timer_->expires_after(resolution);
+        schedule_tick();
+    }
+
+    // under m_
+    void schedule_tick()
+    {
+        timer_->async_wait([this](const asio::error_code& ec)
+        {
+            if (ec) return;
+
+            std::vector<std::shared_ptr<TimerEntry>> fired;
+            {
+                std::lock_guard<std::mutex> lk(m_);
+                collect(1, fired);
+
+                if (armed_count_ == 0 || !timer_)
+                    ticking_ = false;
+                else
+                {
+                    // from the previous deadline, so ticks don't drift
+                    timer_->expires_at(timer_->expiry() + resolution);
+                    schedule_tick();
+                }
+            }
+
+            for (auto& e : fired)
+            {
+                e->callback();
+                e->callback = nullptr;
+            }
+        });
+    }
+
+    std::mutex m_;
+    std::unique_ptr<asio::steady_timer> timer_;
+    std::vector<std::list<std::shared_ptr<TimerEntry>>> slots_;
+    std::size_t cursor_ = 0;
+    std::size_t armed_count_ = 0;
+    bool ticking_ = false;
+    std::atomic<uint64_t> ticks_{0};
+};
@@ -8,8 +8,19 @@
 #include <array>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <type_traits>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include "Frame.hpp"
+#include "PreparedMessage.hpp"
 #include "TcpConnection.hpp"
+#include "MessageDispatcher.hpp"
+#include "TimerWheel.hpp"
 #include <openssl/rand.h>
 #include <openssl/evp.h>
 
@@ -23,17 +34,30 @@ enum class State
     Error
 };
 
-enum class ws_opcode : uint8_t {
-    text   = 0x1,
-    binary = 0x2,
-    close  = 0x8,
-    ping   = 0x9,
-    pong   = 0xA
+// 0 disables a timeout; all of them run on the io_context's shared TimerWheel
+struct TimeoutOptions
+{
+    std::chrono::milliseconds handshake{10000};  // start() until the upgrade completes
+    std::chrono::milliseconds idle{0};           // error out when nothing is received for this long
+    std::chrono::milliseconds heartbeat{0};      // send a ping after this much silence
+    std::chrono::milliseconds close{5000};       // wait for the peer's close frame, then drop the socket
 };
 
-class WebSocket
+// masking of outgoing frames is fixed at compile time: clients mask every frame,
+// servers never do. Only framing changes, the upgrade is always the client side.
+struct ClientRole { static constexpr bool masks = true; };
+struct ServerRole { static constexpr bool masks = false; };
+
+/*
+    Type-erased handler policy: one std::function per event, assigned at runtime
+    through BasicWebSocket::on_*(). A static policy is any type with the same
+    handle_* members; BasicWebSocket calls them directly so they can be inlined.
+    With a MessageDispatcher, text/binary messages go to a copy of the policy on
+    the worker thread, just as FunctionHandlers hands the worker a copy of the
+    std::function: keep shared state behind a pointer and make it thread-safe.
+*/
+struct FunctionHandlers
 {
-public:
     using MessageHandler = std::function<void(const std::vector<std::byte>&)>;
     using BinaryHandler = std::function<void(const std::vector<std::byte>&)>;
     using ErrorHandler   = std::function<void(const std::string&)>;
@@ -42,306 +66,726 @@ public:
     using PongHandler  = std::function<void(const std::vector<std::byte>&)>;
     using CloseHandler = std::function<void(const std::vector<std::byte>&)>;
 
-    explicit WebSocket(std::shared_ptr<TcpConnection> conn,
-                       const std::string& host, 
-                       const std::string& port, 
-                       const std::string& path)
-        : conn_(std::move(conn)),
-          host_(host),
-          port_(port),
-          path_(path)
+    void handle_message(const std::vector<std::byte>& m) { if (message) message(m); }
+    void handle_binary(const std::vector<std::byte>& m)  { if (binary) binary(m); }
+    void handle_error(const std::string& e)              { if (error) error(e); }
+    void handle_open()                                   { if (open) open(); }
+    void handle_ping(const std::vector<std::byte>& p)    { if (ping) ping(p); }
+    void handle_pong(const std::vector<std::byte>& p)    { if (pong) pong(p); }
+    void handle_close(const std::vector<std::byte>& p)   { if (close) close(p); }
+
+    MessageHandler message;
+    BinaryHandler binary;
+    ErrorHandler error;
+    OpenHandler open;
+    PingHandler ping;
+    PongHandler pong;
+    CloseHandler close;
+};
+
+// no-op base for static policies that only care about some events
+struct NullHandlers
+{
+    void handle_message(const std::vector<std::byte>&) {}
+    void handle_binary(const std::vector<std::byte>&) {}
+    void handle_error(const std::string&) {}
+    void handle_open() {}
+    void handle_ping(const std::vector<std::byte>&) {}
+    void handle_pong(const std::vector<std::byte>&) {}
+    void handle_close(const std::vector<std::byte>&) {}
+};
+
+/*
+    A WebSocket connection
+    The object you hold is a handle: the protocol state lives in a Core shared
+    with the callbacks the connection, the strand and the timer wheel hold.
+    Those callbacks keep the Core alive while they run and are no-ops once the
+    handle is gone, so destroying the socket never waits for strand work or a
+    blocked dispatcher push.
+*/
+template <typename Handler, typename Role>
+class BasicWebSocket
+{
+public:
+    using MessageHandler = FunctionHandlers::MessageHandler;
+    using BinaryHandler  = FunctionHandlers::BinaryHandler;
+    using ErrorHandler   = FunctionHandlers::ErrorHandler;
+    using OpenHandler    = FunctionHandlers::OpenHandler;
+    using PingHandler    = FunctionHandlers::PingHandler;
+    using PongHandler    = FunctionHandlers::PongHandler;
+    using CloseHandler   = FunctionHandlers::CloseHandler;
+
+    explicit BasicWebSocket(std::shared_ptr<TcpConnection> conn,
+                            const std::string& host,
+                            const std::string& port,
+                            const std::string& path,
+                            Handler handler = Handler())
+        : core_(std::make_shared<Core>(std::move(conn), host, port, path, std::move(handler)))
+    {
+        core_->attach();
+    }
+
+    /*
+        Once this returns no handler of ours is called again, and none is still
+        running on another thread. It does not wait for anything else: strand
+        work, fired timers and a parked dispatcher push finish on the Core.
+        Destroying the socket from inside one of its own handlers is fine; the
+        rest of that event is dropped. A handler must not block on the thread
+        that destroys its socket.
+    */
+    ~BasicWebSocket() {
+        core_->detach();
+    }
+
+    BasicWebSocket(const BasicWebSocket&) = delete;
+    BasicWebSocket& operator=(const BasicWebSocket&) = delete;
+
+    /*
+        Connect and upgrade. The constructor does not connect: set the handlers
+        and options first, then call start() once. Until then the setters assign
+        directly, so every handler is in place before the first event can fire;
+        afterwards they are queued on the connection's strand.
+    */
+    void start() { core_->start(); }
+
+    // replace the default timeouts, call before start()
+    void use_timeouts(TimeoutOptions t) { core_->use_timeouts(t); }
+
+    void send_text(std::string text) { core_->send_text(std::move(text)); }
+
+    void send_binary(std::vector<std::byte> payload) { core_->send_binary(std::move(payload)); }
+
+    // send every message of the range as its own frame, all of them in one write;
+    // elements are std::string or byte vectors. A client masks each payload into
+    // one contiguous buffer. A server writes the headers from one arena and the
+    // payloads in place (moved from when the range is an rvalue) as a gather write.
+    template <typename Range>
+    void send_batch(Range&& messages, ws_opcode opcode = ws_opcode::text) {
+        core_->send_batch(std::forward<Range>(messages), opcode);
+    }
+
+    // send a message encoded once for many connections: unmasked frames go out
+    // zero-copy from the shared buffer, masked ones cost one masked copy here
+    void send_prepared(const PreparedMessage& msg) { core_->send_prepared(msg); }
+
+    void send_ping(const std::vector<std::byte> payload = {}) { core_->send_ping(payload); }
+
+    void send_pong(const std::vector<std::byte> payload = {}) { core_->send_pong(payload); }
+
+    void send_close(const std::vector<std::byte> payload = {}) { core_->send_close(payload); }
+
+    // deliver text/binary messages on the dispatcher's workers instead of the IO thread
+    void use_dispatcher(std::shared_ptr<MessageDispatcher> d) { core_->use_dispatcher(std::move(d)); }
+
+    // FunctionHandlers only; handlers are read on the connection's strand, so once
+    // started they are also assigned there
+    void on_message(MessageHandler h) { core_->set_handler(core_->handler_.message, std::move(h)); }
+    void on_binary(BinaryHandler h)   { core_->set_handler(core_->handler_.binary, std::move(h)); }
+    void on_error(ErrorHandler h)     { core_->set_handler(core_->handler_.error, std::move(h)); }
+    void on_open(OpenHandler h)       { core_->set_handler(core_->handler_.open, std::move(h)); }
+    void on_ping(PingHandler h)       { core_->set_handler(core_->handler_.ping, std::move(h)); }
+    void on_pong(PongHandler h)       { core_->set_handler(core_->handler_.pong, std::move(h)); }
+    void on_close(CloseHandler h)     { core_->set_handler(core_->handler_.close, std::move(h)); }
+
+    Handler& handler() { return core_->handler_; }
+
+private:
+
+    class Core : public std::enable_shared_from_this<Core>
     {
-        conn_->on_connect([this](bool ssl){
+    public:
+        Core(std::shared_ptr<TcpConnection> conn,
+             const std::string& host,
+             const std::string& port,
+             const std::string& path,
+             Handler handler)
+            : handler_(std::move(handler)),
+              conn_(std::move(conn)),
+              host_(host),
+              port_(port),
+              path_(path),
+              wheel_(&TimerWheel::of(conn_->context()))
+        {
+        }
+
+        // nobody else holds us any more, so the timer handles are ours
+        ~Core() {
+            cancel_timers();
+        }
+
+        // install the connection callbacks, once we are owned by a shared_ptr
+        void attach() {
+            conn_->on_connect(guarded([this](bool ssl){
+
+                if(ssl)
+                    std::cout<<"TCP connection made with SSL ("<<tls_mode_name(conn_->tls_mode())<<")"<<std::endl;
+                else
+                    std::cout<<"TCP connection made without SSL"<<std::endl;
+
+
+                std::string req =
+                    "GET " + path_ + " HTTP/1.1\r\n"
+                    "Host: " + host_ + ":" + port_ + "\r\n"
+                    "Upgrade: websocket\r\n"
+                    "Connection: Upgrade\r\n"
+                    "Sec-WebSocket-Key: "+ get_secret_key() +"\r\n"
+                    "Sec-WebSocket-Version: 13\r\n"
+                    "\r\n";
+
+                state_ = State::HttpHandshake;
+
+                std::vector<std::byte> payload(
+                    reinterpret_cast<const std::byte*>(req.data()),
+                    reinterpret_cast<const std::byte*>(req.data() + req.size())
+                );
+                conn_->send(std::move(payload));
+
+            }));
+
+            conn_->on_data(guarded([this](const void* data, std::size_t size){
+                last_rx_tick_ = wheel_->now();
+                if (state_ == State::HttpHandshake)
+                    handle_handshake_data(data, size);
+                else if (state_ == State::Open)
+                    handle_frame_data(data, size);
+            }));
+
+            conn_->on_error([](const std::error_code& ec){
+                std::cerr << "TCP Error: " << ec.message() << "\n";
+            });
+        }
+
+        // the handle is going away: no handler may start after this, and the
+        // ones running on other threads are waited for. A handler of ours that
+        // is destroying its own socket further up this thread's stack is not.
+        void detach() {
+            {
+                std::unique_lock<std::mutex> lk(gate_m_);
+                alive_ = false;
+
+                const auto& here = handlers_on_this_thread();
+                const auto own = std::count(here.begin(), here.end(), this);
+                gate_cv_.wait(lk, [&]{ return running_ == own; });
+            }
 
-            if(ssl)
-                std::cout<<"TCP connection made with SSL"<<std::endl;
-            else
-                std::cout<<"TCP connection made without SSL"<<std::endl;
+            // construction used to connect; a socket nobody started or drove is
+            // almost certainly code written for that API, say so instead of idling
+            if (!started_.load() && state_ == State::Connecting)
+                std::cerr << "WebSocket " << host_ << ":" << port_ << path_
+                          << " destroyed without start(), it never connected\n";
+        }
 
+        void start() {
+            if (started_.exchange(true)) return;
 
-            std::string req =
-                "GET " + path_ + " HTTP/1.1\r\n"
-                "Host: " + host_ + ":" + port_ + "\r\n"
-                "Upgrade: websocket\r\n"
-                "Connection: Upgrade\r\n"
-                "Sec-WebSocket-Key: "+ get_secret_key() +"\r\n"
-                "Sec-WebSocket-Version: 13\r\n"
-                "\r\n";
+            conn_->dispatch(guarded([this]{
+                if (timeouts_.handshake.count())
+                    handshake_timer_ = arm(timeouts_.handshake, &Core::handshake_timeout);
+            }));
+            conn_->start();
+        }
 
-            state_ = State::HttpHandshake;
+        void use_timeouts(TimeoutOptions t) {
+            configure([this, t]{ timeouts_ = t; });
+        }
 
+        void send_text(std::string text) {
             std::vector<std::byte> payload(
-                reinterpret_cast<const std::byte*>(req.data()),
-                reinterpret_cast<const std::byte*>(req.data() + req.size())
+                reinterpret_cast<std::byte*>(text.data()),
+                reinterpret_cast<std::byte*>(text.data() + text.size())
             );
-            conn_->send(std::move(payload));
+            send_frame(ws_opcode::text, std::move(payload));
+        }
 
-        });
+        void send_binary(std::vector<std::byte> payload) {
+            send_frame(ws_opcode::binary, std::move(payload));
+        }
 
-        conn_->on_data([this](const void* data, std::size_t size){
-            if (state_ == State::HttpHandshake)
-                handle_handshake_data(data, size);
-            else if (state_ == State::Open)
-                handle_frame_data(data, size);
-        });
+        template <typename Range>
+        void send_batch(Range&& messages, ws_opcode opcode) {
+            if constexpr (Role::masks) {
+                // masking copies every payload anyway, so copy it straight into place
+                std::size_t size = 0;
+                for (const auto& m : messages)
+                    size += max_frame_header_size + m.size();
+                if (size == 0) return;
+
+                std::vector<std::byte> frames(size);
+                std::size_t offset = 0;
+                for (const auto& m : messages) {
+                    auto mask = generate_mask();
+                    offset += encode_frame_header(frames.data() + offset, opcode, m.size(), &mask);
+                    copy_masked(frames.data() + offset, payload_data(m), m.size(), mask);
+                    offset += m.size();
+                }
+                frames.resize(offset);
 
-        conn_->on_error([](const std::error_code& ec){
-            std::cerr << "TCP Error: " << ec.message() << "\n";
-        });
+                conn_->send(std::move(frames));
+            } else {
+                auto batch = std::make_shared<GatherWrite>();
 
-        conn_->start();
-    }
+                for (auto&& m : messages) {
+                    if constexpr (std::is_rvalue_reference_v<Range&&>)
+                        batch->payloads.push_back(to_payload(std::move(m)));
+                    else
+                        batch->payloads.push_back(to_payload(m));
+                }
+                if (batch->payloads.empty()) return;
+
+                // headers first: the arena must not grow once buffers point into it
+                const std::size_t count = batch->payloads.size();
+                batch->headers.resize(count * max_frame_header_size);
+                std::vector<std::size_t> header_sizes(count);
+
+                std::size_t offset = 0;
+                for (std::size_t i = 0; i < count; ++i) {
+                    header_sizes[i] = encode_frame_header(batch->headers.data() + offset,
+                                                          opcode, batch->payloads[i].size(), nullptr);
+                    offset += header_sizes[i];
+                }
+                batch->headers.resize(offset);
+
+                batch->buffers.reserve(count * 2);
+                offset = 0;
+                for (std::size_t i = 0; i < count; ++i) {
+                    batch->buffers.push_back(asio::buffer(batch->headers.data() + offset, header_sizes[i]));
+                    if (!batch->payloads[i].empty())
+                        batch->buffers.push_back(asio::buffer(batch->payloads[i]));
+                    offset += header_sizes[i];
+                }
 
-    void send_text(std::string text) {
-        std::vector<std::byte> payload(
-            reinterpret_cast<std::byte*>(text.data()),
-            reinterpret_cast<std::byte*>(text.data() + text.size())
-        );
-        send_frame(ws_opcode::text, std::move(payload));
-    }
+                conn_->send_gather(std::move(batch));
+            }
+        }
 
-    void send_binary(std::vector<std::byte> payload) {
-        send_frame(ws_opcode::binary, std::move(payload));
-    }
+        void send_prepared(const PreparedMessage& msg) {
+            if constexpr (Role::masks) {
+                const std::size_t size = msg.payload_size();
+                auto mask = generate_mask();
 
-    void send_ping(const std::vector<std::byte> payload = {}) {
-        send_frame(ws_opcode::ping, std::move(payload));
-    }
+                std::vector<std::byte> frame(max_frame_header_size + size);
+                std::size_t header_len = encode_frame_header(frame.data(), msg.opcode(), size, &mask);
+                copy_masked(frame.data() + header_len, msg.payload(), size, mask);
+                frame.resize(header_len + size);
 
-    void send_pong(const std::vector<std::byte> payload = {}) {
-        send_frame(ws_opcode::pong, std::move(payload));
-    }
+                conn_->send(std::move(frame));
+                return;
+            }
 
-    void send_close(const std::vector<std::byte> payload = {}) {
-        if (state_ == State::Closing || state_ == State::Closed) return;
+            auto batch = std::make_shared<GatherWrite>();
+            batch->shared.push_back(msg.frame());
+            batch->buffers.push_back(asio::buffer(*msg.frame()));
+            conn_->send_gather(std::move(batch));
+        }
 
-        send_frame(ws_opcode::close, std::move(payload));
-        state_ = State::Closing;
-        if(on_close_) on_close_(payload);
-    }
+        void send_ping(const std::vector<std::byte> payload) {
+            send_frame(ws_opcode::ping, std::move(payload));
+        }
 
-    void on_message(MessageHandler h) { on_message_ = std::move(h); }
-    void on_binary(BinaryHandler h) { on_binary_ = std::move(h); }
-    void on_error(ErrorHandler h)     { on_error_ = std::move(h); }
-    void on_open(OpenHandler h)       { on_open_ = std::move(h); }
-    void on_ping(PingHandler h)       { on_ping_ = std::move(h); }
-    void on_pong(PongHandler h)       { on_pong_ = std::move(h); }
-    void on_close(CloseHandler h)     { on_close_ = std::move(h); }
+        void send_pong(const std::vector<std::byte> payload) {
+            send_frame(ws_opcode::pong, std::move(payload));
+        }
 
-private:
+        void send_close(const std::vector<std::byte> payload) {
+            // state_ is owned by the connection's strand
+            conn_->dispatch(guarded([this, payload]{ close_on_strand(payload); }));
+        }
 
-    std::string get_secret_key() {
-        unsigned char buf[16], out[24];
-        if (RAND_bytes(buf, sizeof(buf)) != 1)
-            throw std::runtime_error("RAND_bytes failed");
-        EVP_EncodeBlock(out, buf, sizeof(buf));
-        return std::string(reinterpret_cast<char*>(out), sizeof(out));
-    }
+        void use_dispatcher(std::shared_ptr<MessageDispatcher> d) {
+            configure([this, d = std::move(d)]() mutable {
+                worker_ = d ? d->assign_worker() : 0;
+                dispatcher_ = std::move(d);
+            });
+        }
+
+        template <typename Slot>
+        void set_handler(Slot& slot, Slot h) {
+            configure([&slot, h = std::move(h)]() mutable { slot = std::move(h); });
+        }
 
-    void handle_handshake_data(const void* data, std::size_t size){
-        const auto* bytes = static_cast<const std::byte*>(data);
+        Handler handler_;
 
-        // add everythng to response_buffer
-        response_buffer_.insert(response_buffer_.end(), bytes, bytes + size);
+    private:
 
-        // go to http header end "\r\n\r\n", if not found, storing in response buffer is enough 
-        auto it = std::search(response_buffer_.begin(), response_buffer_.end(),
-                              http_end.begin(), http_end.end());
-        if (it == response_buffer_.end()) return;
+        // before start() nothing of ours runs on the strand, apply right away;
+        // conn_->start() posts to the strand, which publishes the writes
+        template <typename F>
+        void configure(F&& f) {
+            if (started_.load()) conn_->dispatch(guarded(std::forward<F>(f)));
+            else f();
+        }
+
+        // wrap a callback that re-enters us from the connection, the strand or the
+        // timer wheel: it holds the Core for as long as it runs, and does nothing
+        // once the Core is gone or the handle detached
+        template <typename F>
+        auto guarded(F&& f) {
+            return [weak = this->weak_from_this(), f = std::forward<F>(f)](auto&&... args) mutable {
+                auto self = weak.lock();
+                if (self && self->alive_.load()) f(std::forward<decltype(args)>(args)...);
+            };
+        }
+
+        // cores whose handlers are running on this thread, see detach()
+        static std::vector<const Core*>& handlers_on_this_thread() {
+            thread_local std::vector<const Core*> cores;
+            return cores;
+        }
+
+        // call into the user's handler, unless the handle is gone; no lock is
+        // held meanwhile, so the handler may do anything but block on the
+        // thread that destroys the socket
+        template <typename F>
+        void notify(F&& f) {
+            {
+                std::lock_guard<std::mutex> lk(gate_m_);
+                if (!alive_.load()) return;
+                ++running_;
+            }
+
+            auto& here = handlers_on_this_thread();
+            here.push_back(this);
+            struct Leave {
+                Core* core;
+                std::vector<const Core*>& here;
+                ~Leave() {
+                    here.pop_back();
+                    {
+                        std::lock_guard<std::mutex> lk(core->gate_m_);
+                        --core->running_;
+                    }
+                    core->gate_cv_.notify_all();
+                }
+            } leave{this, here};
+
+            f();
+        }
+
+        void close_on_strand(const std::vector<std::byte>& payload) {
+            if (state_ == State::Closing || state_ == State::Closed) return;
+
+            send_frame(ws_opcode::close, payload);
+            state_ = State::Closing;
+            cancel_timers();
+            if (timeouts_.close.count())
+                close_timer_ = arm(timeouts_.close, &Core::close_timeout);
+            notify([&]{ handler_.handle_close(payload); });
+        }
+
+        // timer callbacks hop onto the connection's strand before touching state_;
+        // a callback that fired after the handle went away does nothing there
+        TimerHandle arm(std::chrono::milliseconds delay, void (Core::*fn)()) {
+            return wheel_->arm(delay, [conn = conn_, task = guarded([this, fn]{ (this->*fn)(); })]{
+                conn->dispatch(task);
+            });
+        }
 
-        // get header as string to parse
-        auto header_len = std::distance(response_buffer_.begin(), it) + http_end.size();
-        std::string headers_str(reinterpret_cast<const char*>(response_buffer_.data()), header_len);
+        void cancel_timers() {
+            wheel_->cancel(handshake_timer_);
+            wheel_->cancel(idle_timer_);
+            wheel_->cancel(heartbeat_timer_);
+            wheel_->cancel(close_timer_);
+        }
 
-        // if not expected header, just throw an error and let the upper level handle it
-        if (headers_str.find("101 Switching Protocols") == std::string::npos) {
+        void fail_and_close(const std::string& reason) {
             state_ = State::Error;
-            if (on_error_) on_error_("Handshake Failed:\r\n" + headers_str);
-            response_buffer_.clear();
-            return;
+            cancel_timers();
+            notify([&]{ handler_.handle_error(reason); });
+            conn_->close();
         }
 
-        //header parsed, if there is any frame data that came along, start adding that to frame_buffer
-        auto body_start = it + http_end.size();
-        if (body_start != response_buffer_.end())
-            frame_buffer_.insert(frame_buffer_.end(), body_start, response_buffer_.end());
+        void handshake_timeout() {
+            if (state_ == State::Connecting || state_ == State::HttpHandshake)
+                fail_and_close("Handshake timeout");
+        }
 
-        // this response is consumed, clear it and declare socket open
-        response_buffer_.clear();
-        state_ = State::Open;
+        // fires once per idle period and re-arms for whatever is left of it
+        void idle_timeout() {
+            if (state_ != State::Open) return;
 
-        if (on_open_) on_open_();
-        parse_frames();
-    }
+            std::size_t limit = TimerWheel::to_ticks(timeouts_.idle);
+            uint64_t silent = wheel_->now() - last_rx_tick_;
+            if (silent >= limit)
+                return fail_and_close("Idle timeout");
 
-    void handle_frame_data(const void* data, std::size_t size){
-        // add to frame_buffer and try to parse
-        const auto* bytes = static_cast<const std::byte*>(data);
-        frame_buffer_.insert(frame_buffer_.end(), bytes, bytes + size);
-        parse_frames();
-    }
+            idle_timer_ = arm(TimerWheel::resolution * (limit - silent), &Core::idle_timeout);
+        }
 
-    void parse_frames() {
-        while (try_parsing_one_frame()) {}
-    }
+        void heartbeat() {
+            if (state_ != State::Open) return;
+
+            if (wheel_->now() - last_rx_tick_ >= TimerWheel::to_ticks(timeouts_.heartbeat))
+                send_frame(ws_opcode::ping, {});
+
+            heartbeat_timer_ = arm(timeouts_.heartbeat, &Core::heartbeat);
+        }
+
+        // the peer never answered our close frame
+        void close_timeout() {
+            if (state_ != State::Closing) return;
+            state_ = State::Closed;
+            conn_->close();
+        }
+
+        std::string get_secret_key() {
+            unsigned char buf[16], out[24];
+            if (RAND_bytes(buf, sizeof(buf)) != 1)
+                throw std::runtime_error("RAND_bytes failed");
+            EVP_EncodeBlock(out, buf, sizeof(buf));
+            return std::string(reinterpret_cast<char*>(out), sizeof(out));
+        }
+
+        void handle_handshake_data(const void* data, std::size_t size){
+            const auto* bytes = static_cast<const std::byte*>(data);
+
+            // add everythng to response_buffer
+            response_buffer_.insert(response_buffer_.end(), bytes, bytes + size);
 
-    bool try_parsing_one_frame() {
-        if (frame_buffer_.size() < 2) return false;
+            // go to http header end "\r\n\r\n", if not found, storing in response buffer is enough
+            auto it = std::search(response_buffer_.begin(), response_buffer_.end(),
+                                  http_end.begin(), http_end.end());
+            if (it == response_buffer_.end()) return;
 
-        const uint8_t b0 = uint8_t(frame_buffer_[0]);
-        const uint8_t b1 = uint8_t(frame_buffer_[1]);
+            // get header as string to parse
+            auto header_len = std::distance(response_buffer_.begin(), it) + http_end.size();
+            std::string headers_str(reinterpret_cast<const char*>(response_buffer_.data()), header_len);
 
-        bool fin    = b0 & 0x80;
-        uint8_t op  = b0 & 0x0F;
-        bool masked = b1 & 0x80;
-        uint64_t len = b1 & 0x7F;
+            // if not expected header, just throw an error and let the upper level handle it
+            if (headers_str.find("101 Switching Protocols") == std::string::npos) {
+                state_ = State::Error;
+                cancel_timers();
+                response_buffer_.clear();
+                notify([&]{ handler_.handle_error("Handshake Failed:\r\n" + headers_str); });
+                return;
+            }
+
+            //header parsed, if there is any frame data that came along, start adding that to frame_buffer
+            auto body_start = it + http_end.size();
+            if (body_start != response_buffer_.end())
+                frame_buffer_.insert(frame_buffer_.end(), body_start, response_buffer_.end());
+
+            // this response is consumed, clear it and declare socket open
+            response_buffer_.clear();
+            state_ = State::Open;
 
-        size_t header_len = 2;
+            wheel_->cancel(handshake_timer_);
+            if (timeouts_.idle.count())
+                idle_timer_ = arm(timeouts_.idle, &Core::idle_timeout);
+            if (timeouts_.heartbeat.count())
+                heartbeat_timer_ = arm(timeouts_.heartbeat, &Core::heartbeat);
 
-        if (len == 126) {
-            if (frame_buffer_.size() < 4) return false;
-            len = (uint8_t(frame_buffer_[2]) << 8) |
-                  uint8_t(frame_buffer_[3]);
-            header_len = 4;
-        } else if (len == 127) {
-            if (frame_buffer_.size() < 10) return false;
-            len = 0;
-            for (int i = 0; i < 8; ++i)
-                len = (len << 8) | uint8_t(frame_buffer_[2 + i]);
-            header_len = 10;
+            notify([&]{ handler_.handle_open(); });
+            parse_frames();
         }
 
-        if (masked) header_len += 4;
-        if (frame_buffer_.size() < header_len + len) return false;
+        void handle_frame_data(const void* data, std::size_t size){
+            // add to frame_buffer and try to parse
+            const auto* bytes = static_cast<const std::byte*>(data);
+            frame_buffer_.insert(frame_buffer_.end(), bytes, bytes + size);
+            parse_frames();
+        }
 
-        // get payload
-        std::vector<std::byte> payload(
-            frame_buffer_.begin() + header_len,
-            frame_buffer_.begin() + header_len + len
-        );
+        // stops once the handle is gone, a handler may have destroyed it
+        void parse_frames() {
+            while (state_ != State::Error && alive_.load() && try_parsing_one_frame()) {}
+        }
 
-        // unmask
-        if (masked) {
-            std::array<std::byte, 4> mask;
-            size_t mask_start = header_len - 4;
-            for (int i = 0; i < 4; ++i) {
-                mask[i] = frame_buffer_[mask_start + i];
+        // hand a complete message to its handler, inline or through the dispatcher
+        void deliver(ws_opcode opcode) {
+            const bool text = opcode == ws_opcode::text;
+
+            if (!dispatcher_) {
+                notify([&]{
+                    if (text) handler_.handle_message(message_buffer_);
+                    else      handler_.handle_binary(message_buffer_);
+                });
+                message_buffer_.clear();
+                return;
             }
-            for (size_t i = 0; i < payload.size(); ++i) {
-                payload[i] ^= mask[i % 4];
+
+            auto msg = std::move(message_buffer_);
+            message_buffer_.clear();
+
+            MessageDispatcher::Task task;
+            if constexpr (std::is_same_v<Handler, FunctionHandlers>) {
+                // the worker gets its own copy of the handler, it may be replaced on the strand meanwhile
+                auto h = text ? handler_.message : handler_.binary;
+                if (!h) return;
+                task = [h = std::move(h), msg = std::move(msg)]{ h(msg); };
+            } else {
+                // same for static policies: the worker must not share ours with the strand,
+                // and the task may outlive this socket
+                task = [h = handler_, text, msg = std::move(msg)]() mutable {
+                    if (text) h.handle_message(msg);
+                    else      h.handle_binary(msg);
+                };
             }
+
+            // under OverflowPolicy::Block this may park the strand; nothing is held
+            // meanwhile, so a worker is free to destroy the socket
+            if (!dispatcher_->push(worker_, std::move(task)))
+                fail_and_close("Dispatch queue overflow");
         }
 
-        // frame not needed since we have payload
-        frame_buffer_.erase(frame_buffer_.begin(),
-                            frame_buffer_.begin() + header_len + len);
+        bool try_parsing_one_frame() {
+            if (frame_buffer_.size() < 2) return false;
+
+            const uint8_t b0 = uint8_t(frame_buffer_[0]);
+            const uint8_t b1 = uint8_t(frame_buffer_[1]);
+
+            bool fin    = b0 & 0x80;
+            uint8_t op  = b0 & 0x0F;
+            bool masked = b1 & 0x80;
+            uint64_t len = b1 & 0x7F;
+
+            size_t header_len = 2;
+
+            if (len == 126) {
+                if (frame_buffer_.size() < 4) return false;
+                len = (uint8_t(frame_buffer_[2]) << 8) |
+                      uint8_t(frame_buffer_[3]);
+                header_len = 4;
+            } else if (len == 127) {
+                if (frame_buffer_.size() < 10) return false;
+                len = 0;
+                for (int i = 0; i < 8; ++i)
+                    len = (len << 8) | uint8_t(frame_buffer_[2 + i]);
+                header_len = 10;
+            }
 
-        switch (static_cast<ws_opcode>(op)) {
-            case ws_opcode::text:
-                message_buffer_.insert(message_buffer_.end(),
-                                    payload.begin(), payload.end());
-                if (fin) {
-                    if(on_message_) on_message_(message_buffer_);
-                    message_buffer_.clear();
-                }
-                break;
-
-            case ws_opcode::binary:
-                message_buffer_.insert(message_buffer_.end(),
-                                    payload.begin(), payload.end());
-                if (fin) {
-                    if(on_binary_) on_binary_(message_buffer_);
-                    message_buffer_.clear();
-                }
-                break;
+            if (masked) header_len += 4;
+            if (frame_buffer_.size() < header_len + len) return false;
 
-            case ws_opcode::ping:
-                if(on_ping_) on_ping_(payload);
-                send_pong(payload); // auto-reply
-                break;
+            // get payload
+            std::vector<std::byte> payload(
+                frame_buffer_.begin() + header_len,
+                frame_buffer_.begin() + header_len + len
+            );
+
+            // unmask
+            if (masked) {
+                std::array<std::byte, 4> mask;
+                size_t mask_start = header_len - 4;
+                for (int i = 0; i < 4; ++i) {
+                    mask[i] = frame_buffer_[mask_start + i];
+                }
+                apply_mask(payload.data(), payload.size(), mask);
+            }
 
-            case ws_opcode::pong:
-                if(on_pong_) on_pong_(payload);
-                break;
+            // frame not needed since we have payload
+            frame_buffer_.erase(frame_buffer_.begin(),
+                                frame_buffer_.begin() + header_len + len);
+
+            switch (static_cast<ws_opcode>(op)) {
+                case ws_opcode::text:
+                    message_buffer_.insert(message_buffer_.end(),
+                                        payload.begin(), payload.end());
+                    if (fin) deliver(ws_opcode::text);
+                    break;
+
+                case ws_opcode::binary:
+                    message_buffer_.insert(message_buffer_.end(),
+                                        payload.begin(), payload.end());
+                    if (fin) deliver(ws_opcode::binary);
+                    break;
+
+                case ws_opcode::ping:
+                    notify([&]{ handler_.handle_ping(payload); });
+                    send_pong(payload); // auto-reply
+                    break;
+
+                case ws_opcode::pong:
+                    notify([&]{ handler_.handle_pong(payload); });
+                    break;
+
+                case ws_opcode::close:
+                    notify([&]{ handler_.handle_close(payload); });
+                    if(state_ != State::Closing) close_on_strand(payload);
+                    state_ = State::Closed;
+                    cancel_timers();
+                    break;
+
+                default:
+                    break;
+            }
 
-            case ws_opcode::close:
-                if(on_close_) on_close_(payload);
-                if(state_ != State::Closing) send_close(payload);
-                state_ = State::Closed;
-                break;
 
-            default:
-                break;
+            return true;
         }
 
+        void send_frame(ws_opcode opcode, std::vector<std::byte> payload) {
+            std::vector<std::byte> frame(max_frame_header_size + payload.size());
+            std::size_t header_len;
 
-        return true;
-    }
-
-    void send_frame(ws_opcode opcode, std::vector<std::byte> payload) {
-        std::vector<std::byte> frame;
+            if constexpr (Role::masks) {
+                auto mask = generate_mask();
+                header_len = encode_frame_header(frame.data(), opcode, payload.size(), &mask);
+                apply_mask(payload.data(), payload.size(), mask);
+            } else {
+                header_len = encode_frame_header(frame.data(), opcode, payload.size(), nullptr);
+            }
 
-        //building header
-        frame.push_back(std::byte(0x80 | uint8_t(opcode)));
+            // add the payload right after the header
+            if (!payload.empty())
+                std::memcpy(frame.data() + header_len, payload.data(), payload.size());
+            frame.resize(header_len + payload.size());
 
-        uint8_t mask_bit = masking_ ? 0x80 : 0x00;
-        size_t len = payload.size();
+            conn_->send(std::move(frame));
+        }
 
-        if (len <= 125) {
-            frame.push_back(std::byte(mask_bit | len));
-        } else if (len <= 65535) {
-            frame.push_back(std::byte(mask_bit | 126));
-            frame.push_back(std::byte((len >> 8) & 0xff));
-            frame.push_back(std::byte(len & 0xff));
-        } else {
-            frame.push_back(std::byte(mask_bit | 127));
-            for (int i = 7; i >= 0; --i)
-                frame.push_back(std::byte((len >> (8 * i)) & 0xff));
+        static std::vector<std::byte> to_payload(std::vector<std::byte>&& v) { return std::move(v); }
+        static std::vector<std::byte> to_payload(const std::vector<std::byte>& v) { return v; }
+        static std::vector<std::byte> to_payload(const std::string& s) {
+            return std::vector<std::byte>(
+                reinterpret_cast<const std::byte*>(s.data()),
+                reinterpret_cast<const std::byte*>(s.data() + s.size()));
         }
 
-        if (masking_) {
-            auto mask = generate_mask();
-            // add mask to frame
-            frame.insert(frame.end(), mask.begin(), mask.end());
+        static const std::byte* payload_data(const std::vector<std::byte>& v) { return v.data(); }
+        static const std::byte* payload_data(const std::string& s) {
+            return reinterpret_cast<const std::byte*>(s.data());
+        }
 
-            // mask the payload
-            for (size_t i = 0; i < payload.size(); ++i)
-                payload[i] ^= mask[i % 4];
+        std::array<std::byte, 4> generate_mask() {
+            // send_* may be called from any thread
+            thread_local std::random_device rd;
+            std::array<std::byte, 4> mask;
+            for (auto& b : mask) b = std::byte(rd() & 0xFF);
+            return mask;
         }
 
-        // add the payload
-        frame.insert(frame.end(),
-                     std::make_move_iterator(payload.begin()),
-                     std::make_move_iterator(payload.end()));
+        static constexpr std::array<std::byte, 4> http_end = { std::byte{'\r'}, std::byte{'\n'},
+                                                               std::byte{'\r'}, std::byte{'\n'} };
 
-        conn_->send(std::move(frame));
-    }
+        std::shared_ptr<TcpConnection> conn_;
+        std::string host_, port_, path_;
 
-    std::array<std::byte, 4> generate_mask() {
-        static std::random_device rd;
-        std::array<std::byte, 4> mask;
-        for (auto& b : mask) b = std::byte(rd() & 0xFF);
-        return mask;
-    }
+        std::vector<std::byte> response_buffer_;
+        std::vector<std::byte> frame_buffer_;
+        std::vector<std::byte> message_buffer_;
+        State state_ = State::Connecting;
 
-private:
-    static constexpr std::array<std::byte, 4> http_end = { std::byte{'\r'}, std::byte{'\n'},
-                                                           std::byte{'\r'}, std::byte{'\n'} };
-
-    std::shared_ptr<TcpConnection> conn_;
-    std::string host_, port_, path_;
-    bool masking_ = true;
-
-    std::vector<std::byte> response_buffer_;
-    std::vector<std::byte> frame_buffer_;
-    std::vector<std::byte> message_buffer_;
-    State state_ = State::Connecting;
-
-    MessageHandler on_message_;
-    BinaryHandler on_binary_;
-    ErrorHandler on_error_;
-    OpenHandler on_open_;
-    PingHandler  on_ping_;
-    PongHandler  on_pong_;
-    CloseHandler on_close_;
+        std::atomic<bool> started_{false};
+
+        // cleared by detach(); running_ counts handlers in progress, on any thread
+        std::atomic<bool> alive_{true};
+        std::mutex gate_m_;
+        std::condition_variable gate_cv_;
+        std::ptrdiff_t running_ = 0;
+
+        std::shared_ptr<MessageDispatcher> dispatcher_;
+        std::size_t worker_ = 0;
+
+        TimerWheel* wheel_;
+        TimeoutOptions timeouts_;
+        uint64_t last_rx_tick_ = 0;
+        TimerHandle handshake_timer_;
+        TimerHandle idle_timer_;
+        TimerHandle heartbeat_timer_;
+        TimerHandle close_timer_;
+    };
+
+    std::shared_ptr<Core> core_;
 };
+
+using WebSocket = BasicWebSocket<FunctionHandlers, ClientRole>;
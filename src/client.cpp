@@ -7,6 +7,7 @@
 
 #include "TcpConnection.hpp"
 #include "WebSocket.hpp"
+#include "MessageDispatcher.hpp"
 
 #include "utils.hpp"
 
@@ -18,6 +19,12 @@ int main() {
     auto work = asio::make_work_guard(io);
     std::thread io_thread([&]{ io.run(); });
 
+    // printing responses is slow, keep it off the IO thread
+    auto dispatcher = std::make_shared<MessageDispatcher>();
+
+    // registered with the ring on io_uring builds, used by ws:// connections
+    auto read_buffers = std::make_shared<RegisteredReadBuffers>(io, 4);
+
     std::shared_ptr<TcpConnection> conn;
     std::shared_ptr<WebSocket> ws;
     bool connected = false;
@@ -39,7 +46,9 @@ int main() {
             iss >> host >> port >> path;
 
             conn = std::make_shared<TcpConnection>(io, host, port);
+            conn->use_read_buffers(read_buffers);
             ws = std::make_shared<WebSocket>(conn, host, port, path);
+            ws->use_dispatcher(dispatcher);
 
             ws->on_open([&]{ 
                 connected = true;
@@ -76,6 +85,8 @@ int main() {
             ws->on_error([](const std::string& err){ 
                 std::cerr << "[Error] " << err << "\n"; 
             });
+
+            ws->start();
         }
         else if (cmd == "exit" || cmd == "quit") {
             if (connected) ws->send_close();
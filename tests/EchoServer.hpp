@@ -0,0 +1,240 @@
+#pragma once
+
+#include <asio.hpp>
+#include <asio/ssl.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using asio::ip::tcp;
+
+/*
+    Minimal loopback WebSocket echo server used by the tests and benchmarks
+    Plain TCP by default: a TLS ClientHello is answered by closing the socket,
+    which makes TcpConnection fall back to a plain connection. Given a server
+    ssl::context it speaks wss:// instead.
+    A fragmented message is echoed as one frame once its FIN frame arrives, so
+    a client that splits a request over two writes gets nothing back until the
+    second one is in; control frames are echoed right away.
+    Every session runs on its own strand, so the server may share a
+    multi-threaded io_context with the clients under test
+*/
+class EchoServer
+{
+public:
+    // tls must outlive the server
+    explicit EchoServer(asio::io_context& io, asio::ssl::context* tls = nullptr)
+        : io_(io),
+          tls_(tls),
+          acceptor_(asio::make_strand(io),
+                    tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0))
+    {
+        do_accept();
+    }
+
+    std::string port() const
+    {
+        return std::to_string(acceptor_.local_endpoint().port());
+    }
+
+    void stop()
+    {
+        asio::post(acceptor_.get_executor(), [this]{ acceptor_.close(); });
+    }
+
+private:
+    class Session : public std::enable_shared_from_this<Session>
+    {
+    public:
+        Session(tcp::socket socket, asio::ssl::context* tls)
+            : socket_(std::move(socket))
+        {
+            if (tls) tls_stream_ = std::make_unique<asio::ssl::stream<tcp::socket&>>(socket_, *tls);
+        }
+
+        void start()
+        {
+            asio::error_code ignored;
+            socket_.set_option(tcp::no_delay(true), ignored);
+            if (!tls_stream_) return do_read();
+
+            auto self = shared_from_this();
+            tls_stream_->async_handshake(asio::ssl::stream_base::server,
+                [this, self](const asio::error_code& ec)
+                {
+                    if (!ec) do_read();
+                });
+        }
+
+    private:
+        template <typename Handler>
+        void read_some(Handler&& h)
+        {
+            if (tls_stream_)
+                tls_stream_->async_read_some(asio::buffer(read_buf_), std::forward<Handler>(h));
+            else
+                socket_.async_read_some(asio::buffer(read_buf_), std::forward<Handler>(h));
+        }
+
+        template <typename Handler>
+        void write(Handler&& h)
+        {
+            if (tls_stream_)
+                asio::async_write(*tls_stream_, asio::buffer(out_), std::forward<Handler>(h));
+            else
+                asio::async_write(socket_, asio::buffer(out_), std::forward<Handler>(h));
+        }
+
+        void do_read()
+        {
+            auto self = shared_from_this();
+            read_some(
+                [this, self](const asio::error_code& ec, std::size_t n)
+                {
+                    if (ec) return;
+
+                    in_.insert(in_.end(), read_buf_.begin(), read_buf_.begin() + n);
+
+                    if (!upgraded_ && !handle_upgrade()) return;
+                    if (upgraded_) handle_frames();
+
+                    if (out_.empty()) return do_read();
+
+                    write(
+                        [this, self](const asio::error_code& ec, std::size_t)
+                        {
+                            if (ec || closing_) return;
+                            out_.clear();
+                            do_read();
+                        });
+                });
+        }
+
+        // false when the session should be dropped
+        bool handle_upgrade()
+        {
+            // TLS ClientHello on a plain server
+            if (!tls_stream_ && !in_.empty() && uint8_t(in_[0]) == 0x16) return false;
+
+            static const std::string end = "\r\n\r\n";
+            auto it = std::search(in_.begin(), in_.end(),
+                reinterpret_cast<const std::byte*>(end.data()),
+                reinterpret_cast<const std::byte*>(end.data()) + end.size());
+            if (it == in_.end()) return true;
+
+            in_.erase(in_.begin(), it + end.size());
+            upgraded_ = true;
+
+            static const std::string resp =
+                "HTTP/1.1 101 Switching Protocols\r\n"
+                "Upgrade: websocket\r\n"
+                "Connection: Upgrade\r\n"
+                "\r\n";
+            auto* p = reinterpret_cast<const std::byte*>(resp.data());
+            out_.insert(out_.end(), p, p + resp.size());
+            return true;
+        }
+
+        // echo every complete client message back unmasked
+        void handle_frames()
+        {
+            while (in_.size() >= 2)
+            {
+                const uint8_t b0 = uint8_t(in_[0]);
+                const uint8_t b1 = uint8_t(in_[1]);
+                bool masked = b1 & 0x80;
+                uint64_t len = b1 & 0x7F;
+                size_t header_len = 2;
+
+                if (len == 126) {
+                    if (in_.size() < 4) return;
+                    len = (uint8_t(in_[2]) << 8) | uint8_t(in_[3]);
+                    header_len = 4;
+                } else if (len == 127) {
+                    if (in_.size() < 10) return;
+                    len = 0;
+                    for (int i = 0; i < 8; ++i)
+                        len = (len << 8) | uint8_t(in_[2 + i]);
+                    header_len = 10;
+                }
+
+                size_t mask_start = header_len;
+                if (masked) header_len += 4;
+                if (in_.size() < header_len + len) return;
+
+                std::vector<std::byte> payload(len);
+                for (size_t i = 0; i < len; ++i) {
+                    std::byte b = in_[header_len + i];
+                    if (masked) b ^= in_[mask_start + (i % 4)];
+                    payload[i] = b;
+                }
+                in_.erase(in_.begin(), in_.begin() + header_len + len);
+
+                const uint8_t opcode = b0 & 0x0F;
+                if (opcode >= 0x8) {
+                    echo(b0, payload);
+                    if (opcode == 0x8) {
+                        closing_ = true;
+                        return;
+                    }
+                    continue;
+                }
+
+                // data frame: the first one names the message type, continuations add to it
+                if (opcode != 0x0) message_opcode_ = opcode;
+                message_.insert(message_.end(), payload.begin(), payload.end());
+                if (b0 & 0x80) {
+                    echo(uint8_t(0x80 | message_opcode_), message_);
+                    message_.clear();
+                }
+            }
+        }
+
+        void echo(uint8_t b0, const std::vector<std::byte>& payload)
+        {
+            const uint64_t len = payload.size();
+            out_.push_back(std::byte(b0));
+            if (len <= 125) {
+                out_.push_back(std::byte(len));
+            } else if (len <= 65535) {
+                out_.push_back(std::byte(126));
+                out_.push_back(std::byte((len >> 8) & 0xff));
+                out_.push_back(std::byte(len & 0xff));
+            } else {
+                out_.push_back(std::byte(127));
+                for (int i = 7; i >= 0; --i)
+                    out_.push_back(std::byte((len >> (8 * i)) & 0xff));
+            }
+            out_.insert(out_.end(), payload.begin(), payload.end());
+        }
+
+        tcp::socket socket_;
+        std::unique_ptr<asio::ssl::stream<tcp::socket&>> tls_stream_;
+        std::array<std::byte, 4096> read_buf_;
+        std::vector<std::byte> in_;
+        std::vector<std::byte> out_;
+        std::vector<std::byte> message_;   // fragments of the message in progress
+        uint8_t message_opcode_ = 0x1;
+        bool upgraded_ = false;
+        bool closing_ = false;
+    };
+
+    void do_accept()
+    {
+        acceptor_.async_accept(asio::make_strand(io_),
+            [this](const asio::error_code& ec, tcp::socket socket)
+            {
+                if (ec) return;
+                std::make_shared<Session>(std::move(socket), tls_)->start();
+                do_accept();
+            });
+    }
+
+    asio::io_context& io_;
+    asio::ssl::context* tls_;
+    tcp::acceptor acceptor_;
+};
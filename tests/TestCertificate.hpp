@@ -0,0 +1,86 @@
+#pragma once
+
+#include <asio.hpp>
+#include <asio/ssl.hpp>
+#include <string>
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+#include "TcpConnection.hpp"
+
+/*
+    Self-signed P-256 certificate for 127.0.0.1, generated once per process
+    Lets the tests and benchmarks run a wss:// EchoServer on loopback: the
+    server context uses it as its chain, the client trusts it as a CA
+*/
+struct TestCertificate
+{
+    std::string cert_pem;
+    std::string key_pem;
+};
+
+inline std::string bio_string(BIO* bio)
+{
+    char* data = nullptr;
+    long len = BIO_get_mem_data(bio, &data);
+    return std::string(data, static_cast<std::size_t>(len));
+}
+
+inline const TestCertificate& test_certificate()
+{
+    static const TestCertificate cert = []{
+        EVP_PKEY* key = nullptr;
+        EVP_PKEY_CTX* kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+        EVP_PKEY_keygen_init(kctx);
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx, NID_X9_62_prime256v1);
+        EVP_PKEY_keygen(kctx, &key);
+        EVP_PKEY_CTX_free(kctx);
+
+        X509* x = X509_new();
+        X509_set_version(x, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(x), 1);
+        X509_gmtime_adj(X509_getm_notBefore(x), -60);
+        X509_gmtime_adj(X509_getm_notAfter(x), 24 * 60 * 60);
+        X509_set_pubkey(x, key);
+
+        X509_NAME* name = X509_get_subject_name(x);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                                   reinterpret_cast<const unsigned char*>("127.0.0.1"), -1, -1, 0);
+        X509_set_issuer_name(x, name);
+
+        X509_EXTENSION* ca = X509V3_EXT_conf_nid(nullptr, nullptr, NID_basic_constraints,
+                                                 const_cast<char*>("critical,CA:TRUE"));
+        X509_add_ext(x, ca, -1);
+        X509_EXTENSION_free(ca);
+        X509_sign(x, key, EVP_sha256());
+
+        BIO* cert_bio = BIO_new(BIO_s_mem());
+        BIO* key_bio = BIO_new(BIO_s_mem());
+        PEM_write_bio_X509(cert_bio, x);
+        PEM_write_bio_PrivateKey(key_bio, key, nullptr, nullptr, 0, nullptr, nullptr);
+
+        TestCertificate c{bio_string(cert_bio), bio_string(key_bio)};
+        BIO_free(cert_bio);
+        BIO_free(key_bio);
+        X509_free(x);
+        EVP_PKEY_free(key);
+        return c;
+    }();
+    return cert;
+}
+
+inline void use_test_certificate(asio::ssl::context& server)
+{
+    const auto& c = test_certificate();
+    server.use_certificate_chain(asio::buffer(c.cert_pem));
+    server.use_private_key(asio::buffer(c.key_pem), asio::ssl::context::pem);
+}
+
+// call before start()
+inline void trust_test_certificate(TcpConnection& conn)
+{
+    conn.ssl_context().add_certificate_authority(asio::buffer(test_certificate().cert_pem));
+}
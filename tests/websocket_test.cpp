@@ -5,8 +5,17 @@
 #include <memory>
 #include <cstddef>
 #include <cstring>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
 
 #include "WebSocket.hpp"
+#include "EchoServer.hpp"
+#include "TestCertificate.hpp"
+#include "RegisteredBuffers.hpp"
 
 /*
     Captures callbacks set by WebSocket
@@ -22,6 +31,26 @@ public:
         sent_frames.push_back(std::move(data));
     }
 
+    // no io is running, so strand work is executed inline
+    void dispatch(std::function<void()> f) override {
+        f();
+    }
+
+    void close() override {
+        closed = true;
+    }
+
+    // a gather write is recorded as the single buffer it would put on the wire
+    void send_gather(std::shared_ptr<GatherWrite> batch) override {
+        std::vector<std::byte> flat;
+        for (const auto& b : batch->buffers) {
+            auto* p = static_cast<const std::byte*>(b.data());
+            flat.insert(flat.end(), p, p + b.size());
+        }
+        sent_frames.push_back(std::move(flat));
+        last_gather = std::move(batch);
+    }
+
     void trigger_connected() {
         if (on_connect_)
             on_connect_(false);
@@ -33,6 +62,8 @@ public:
     }
 
     std::vector<std::vector<std::byte>> sent_frames;
+    bool closed = false;
+    std::shared_ptr<GatherWrite> last_gather;
 
 private:
     static asio::io_context dummy_io_;
@@ -65,6 +96,77 @@ static std::vector<std::byte> text_frame(
     return f;
 }
 
+static const char* switching_protocols =
+    "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n\r\n";
+
+template <typename Pred>
+static bool wait_until(Pred pred, std::chrono::milliseconds timeout = std::chrono::seconds(5)) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!pred()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+template <typename Socket>
+struct LoopbackClient {
+    std::shared_ptr<TcpConnection> conn;
+    std::shared_ptr<Socket> ws;
+};
+
+/*
+    An EchoServer and the client sockets talking to it, all on one io_context
+    add() builds a socket for the test to configure and start(); run() drives
+    the io_context on `threads` threads until done() holds or the timeout passes,
+    then stops it again. Sockets live as long as the Loopback.
+*/
+class Loopback {
+public:
+    explicit Loopback(asio::ssl::context* tls = nullptr) : server(io, tls) {}
+    ~Loopback() { stop(); }
+
+    template <typename Socket = WebSocket>
+    LoopbackClient<Socket> add(const SocketOptions& opts = {}) {
+        auto conn = std::make_shared<TcpConnection>(io, "127.0.0.1", server.port(), opts);
+        auto ws = std::make_shared<Socket>(conn, "127.0.0.1", server.port(), "/");
+        sockets_.push_back(ws);
+        return {conn, ws};
+    }
+
+    // keep the io_context running on background threads until stop()
+    void start(int threads = 1) {
+        work_.emplace(io.get_executor());
+        for (int t = 0; t < threads; ++t)
+            threads_.emplace_back([this]{ io.run(); });
+    }
+
+    void stop() {
+        if (threads_.empty()) return;
+        io.stop();
+        for (auto& t : threads_) t.join();
+        threads_.clear();
+        work_.reset();
+        io.restart();
+    }
+
+    template <typename Pred>
+    bool run(Pred done, int threads = 1, std::chrono::milliseconds timeout = std::chrono::seconds(10)) {
+        start(threads);
+        bool ok = wait_until(done, timeout);
+        stop();
+        return ok;
+    }
+
+    asio::io_context io;
+    EchoServer server;
+
+private:
+    std::vector<std::shared_ptr<void>> sockets_;
+    std::vector<std::thread> threads_;
+    std::optional<asio::executor_work_guard<asio::io_context::executor_type>> work_;
+};
+
 /* -----
    Tests
 -------- */
@@ -162,3 +264,836 @@ TEST_CASE("WebSocket emits close on close frame")
 
     REQUIRE(closed == true);
 }
+
+TEST_CASE("WebSocket client sends a batch as one contiguous buffer")
+{
+    auto conn = std::make_shared<DummyConnection>();
+    WebSocket ws(conn, "x", "80", "/");
+
+    conn->trigger_connected();
+    conn->inject(bytes(switching_protocols));
+
+    std::vector<std::string> messages = {"a", "", std::string(300, 'b')};
+    ws.send_batch(messages);
+
+    // one send() for the handshake, one for the batch, no gather write
+    REQUIRE(conn->sent_frames.size() == 2);
+    REQUIRE(conn->last_gather == nullptr);
+
+    // walk the masked frames of the batch
+    const auto& wire = conn->sent_frames[1];
+    size_t pos = 0;
+    for (const auto& expected : messages) {
+        REQUIRE(uint8_t(wire[pos]) == 0x81);
+        size_t len = uint8_t(wire[pos + 1]) & 0x7F;
+        pos += 2;
+        if (len == 126) {
+            len = (uint8_t(wire[pos]) << 8) | uint8_t(wire[pos + 1]);
+            pos += 2;
+        }
+        std::array<std::byte, 4> mask = {wire[pos], wire[pos + 1], wire[pos + 2], wire[pos + 3]};
+        pos += 4;
+
+        REQUIRE(len == expected.size());
+        for (size_t i = 0; i < len; ++i)
+            REQUIRE(char(wire[pos + i] ^ mask[i % 4]) == expected[i]);
+        pos += len;
+    }
+    REQUIRE(pos == wire.size());
+}
+
+TEST_CASE("PreparedMessage is masked per connection")
+{
+    auto msg = PreparedMessage::text(std::string(200, 'p'));
+    REQUIRE(msg.frame()->size() == 4 + 200);  // unmasked header with 16 bit length
+
+    for (int c = 0; c < 2; ++c) {
+        auto conn = std::make_shared<DummyConnection>();
+        WebSocket ws(conn, "x", "80", "/");
+        conn->trigger_connected();
+        conn->inject(bytes(switching_protocols));
+
+        ws.send_prepared(msg);
+
+        REQUIRE(conn->sent_frames.size() == 2);  // Handshake + prepared frame
+        const auto& f = conn->sent_frames[1];
+        REQUIRE(f.size() == 8 + 200);
+        REQUIRE(uint8_t(f[0]) == 0x81);
+        REQUIRE(uint8_t(f[1]) == (0x80 | 126));
+
+        std::array<std::byte, 4> mask = {f[4], f[5], f[6], f[7]};
+        for (size_t i = 0; i < 200; ++i)
+            REQUIRE((f[8 + i] ^ mask[i % 4]) == std::byte{'p'});
+    }
+
+    // the shared frame itself is never masked in place
+    REQUIRE(msg.payload()[0] == std::byte{'p'});
+}
+
+TEST_CASE("TimerWheel fires, cancels and handles delays longer than one turn")
+{
+    asio::io_context io;
+    auto& wheel = TimerWheel::of(io);
+    REQUIRE(&wheel == &TimerWheel::of(io));  // one wheel per io_context
+
+    std::vector<int> fired;
+    auto tick = TimerWheel::resolution;
+    wheel.arm(tick * 2, [&]{ fired.push_back(2); });
+    auto cancelled = wheel.arm(tick * 3, [&]{ fired.push_back(3); });
+    wheel.arm(tick * (TimerWheel::slot_count + 5), [&]{ fired.push_back(-1); });
+
+    wheel.cancel(cancelled);
+    wheel.advance(1);
+    REQUIRE(fired.empty());
+    wheel.advance(4);
+    REQUIRE(fired == std::vector<int>{2});
+
+    // lands in slot 5 but must wait one full turn
+    wheel.advance(TimerWheel::slot_count - 1);
+    REQUIRE(fired == std::vector<int>{2});
+    wheel.advance(1);
+    REQUIRE(fired == std::vector<int>{2, -1});
+
+    wheel.cancel(cancelled);  // already cancelled, no-op
+}
+
+TEST_CASE("WebSocket times out an idle connection and sends heartbeats")
+{
+    auto conn = std::make_shared<DummyConnection>();
+    WebSocket ws(conn, "x", "80", "/");
+    auto& wheel = TimerWheel::of(conn->context());
+
+    TimeoutOptions t;
+    t.idle = TimerWheel::resolution * 3;
+    t.heartbeat = TimerWheel::resolution * 2;
+    ws.use_timeouts(t);
+
+    std::string error;
+    ws.on_error([&](const std::string& e) { error = e; });
+
+    conn->trigger_connected();
+    conn->inject(bytes(switching_protocols));
+
+    wheel.advance(2);
+    REQUIRE(conn->sent_frames.size() == 2);  // Handshake + heartbeat ping
+    REQUIRE(uint8_t(conn->sent_frames[1][0]) == 0x89);
+
+    // traffic pushes the idle deadline back
+    conn->inject(text_frame("still here"));
+    wheel.advance(2);
+    REQUIRE(error.empty());
+
+    wheel.advance(1);
+    REQUIRE(error == "Idle timeout");
+    REQUIRE(conn->closed);
+}
+
+TEST_CASE("WebSocket drops the connection when the close handshake times out")
+{
+    auto conn = std::make_shared<DummyConnection>();
+    WebSocket ws(conn, "x", "80", "/");
+    auto& wheel = TimerWheel::of(conn->context());
+
+    conn->trigger_connected();
+    conn->inject(bytes(switching_protocols));
+
+    ws.send_close();
+    REQUIRE_FALSE(conn->closed);
+
+    wheel.advance(TimerWheel::to_ticks(TimeoutOptions{}.close));
+    REQUIRE(conn->closed);
+}
+
+// strand work is queued until the test runs it, like a busy io thread
+class QueuedConnection : public DummyConnection {
+public:
+    void dispatch(std::function<void()> f) override {
+        queued.push_back(std::move(f));
+    }
+
+    void run_queued() {
+        auto tasks = std::move(queued);
+        queued.clear();
+        for (auto& t : tasks) t();
+    }
+
+    std::vector<std::function<void()>> queued;
+};
+
+TEST_CASE("WebSocket timers that already fired do not reach a destroyed socket")
+{
+    auto conn = std::make_shared<QueuedConnection>();
+    auto& wheel = TimerWheel::of(conn->context());
+    {
+        WebSocket ws(conn, "x", "80", "/");
+
+        TimeoutOptions t;
+        t.heartbeat = TimerWheel::resolution;
+        ws.use_timeouts(t);
+
+        conn->trigger_connected();
+        conn->inject(bytes(switching_protocols));
+
+        // the heartbeat fires and queues its work on the strand, then the socket goes
+        wheel.advance(1);
+        REQUIRE(conn->queued.size() == 1);
+    }
+
+    conn->run_queued();
+    conn->inject(text_frame("late"));
+    REQUIRE(conn->sent_frames.size() == 1);  // only the handshake, no ping
+}
+
+struct RecordingHandlers : NullHandlers {
+    std::vector<std::string>* received;
+
+    void handle_message(const std::vector<std::byte>& m) {
+        received->emplace_back(reinterpret_cast<const char*>(m.data()), m.size());
+    }
+};
+
+TEST_CASE("BasicWebSocket with a static policy and server role")
+{
+    auto conn = std::make_shared<DummyConnection>();
+    std::vector<std::string> received;
+    BasicWebSocket<RecordingHandlers, ServerRole> ws(conn, "x", "80", "/",
+                                                     RecordingHandlers{{}, &received});
+
+    conn->trigger_connected();
+    conn->inject(bytes(switching_protocols));
+    conn->inject(text_frame("hello"));
+    REQUIRE(received == std::vector<std::string>{"hello"});
+
+    // no mask bit, no mask key
+    ws.send_text("hi");
+    REQUIRE(conn->sent_frames.size() == 2);
+    REQUIRE(conn->sent_frames[1] == std::vector<std::byte>{
+        std::byte{0x81}, std::byte{0x02}, std::byte{'h'}, std::byte{'i'}});
+
+    // unmasked prepared messages go out straight from the shared buffer
+    auto msg = PreparedMessage::text("broadcast");
+    ws.send_prepared(msg);
+    REQUIRE(conn->last_gather->buffers.size() == 1);
+    REQUIRE(conn->last_gather->buffers[0].data() == msg.frame()->data());
+}
+
+TEST_CASE("BasicWebSocket server sends a batch as one gather write")
+{
+    auto conn = std::make_shared<DummyConnection>();
+    BasicWebSocket<NullHandlers, ServerRole> ws(conn, "x", "80", "/");
+
+    conn->trigger_connected();
+    conn->inject(bytes(switching_protocols));
+
+    std::vector<std::vector<std::byte>> messages = {bytes("a"), {}, bytes(std::string(300, 'b'))};
+    const std::byte* big = messages[2].data();
+    ws.send_batch(std::move(messages), ws_opcode::binary);
+
+    REQUIRE(conn->sent_frames.size() == 2);
+    REQUIRE(conn->last_gather != nullptr);
+
+    // a header per message, the empty payload adds no buffer, the moved one is sent in place
+    const auto& buffers = conn->last_gather->buffers;
+    REQUIRE(buffers.size() == 5);
+    REQUIRE(buffers[4].data() == big);
+
+    const auto& wire = conn->sent_frames[1];
+    REQUIRE(wire.size() == 3 + 2 + 4 + 300);
+    REQUIRE(wire[0] == std::byte{0x82});
+    REQUIRE(wire[1] == std::byte{0x01});
+    REQUIRE(wire[2] == std::byte{'a'});
+    REQUIRE(wire[3] == std::byte{0x82});
+    REQUIRE(wire[4] == std::byte{0x00});
+}
+
+TEST_CASE("gather writes pass up to IOV_MAX buffers per sendmsg")
+{
+    std::vector<char> data(3000);
+    std::vector<asio::const_buffer> buffers;
+    for (std::size_t i = 0; i < data.size(); ++i)
+        buffers.push_back(asio::buffer(&data[i], 1));
+
+    std::vector<iovec> iov(max_gather_buffers);
+    REQUIRE(gather_iovecs(buffers, 0, iov.data(), iov.size()) == max_gather_buffers);
+    REQUIRE(max_gather_buffers > 16);
+
+    // resumes after a partial write, the tail of a buffer first
+    std::vector<asio::const_buffer> two = {asio::buffer(data.data(), 10), asio::buffer(data.data() + 10, 5)};
+    REQUIRE(gather_iovecs(two, 4, iov.data(), iov.size()) == 2);
+    REQUIRE(iov[0].iov_base == data.data() + 4);
+    REQUIRE(iov[0].iov_len == 6);
+    REQUIRE(gather_iovecs(two, 12, iov.data(), iov.size()) == 1);
+    REQUIRE(iov[0].iov_len == 3);
+    REQUIRE(gather_iovecs(two, 15, iov.data(), iov.size()) == 0);
+}
+
+struct CountingHandlers : NullHandlers {
+    std::atomic<int>* delivered;
+    int calls = 0;  // per copy
+
+    void handle_message(const std::vector<std::byte>&) {
+        ++calls;
+        ++*delivered;
+    }
+};
+
+TEST_CASE("BasicWebSocket hands a dispatcher worker its own copy of a static policy")
+{
+    std::atomic<int> delivered{0};
+    auto dispatcher = std::make_shared<MessageDispatcher>();
+
+    auto conn = std::make_shared<DummyConnection>();
+    {
+        BasicWebSocket<CountingHandlers, ClientRole> ws(conn, "x", "80", "/",
+                                                        CountingHandlers{{}, &delivered});
+        ws.use_dispatcher(dispatcher);
+
+        conn->trigger_connected();
+        conn->inject(bytes(switching_protocols));
+        conn->inject(text_frame("one"));
+        conn->inject(text_frame("two"));
+
+        REQUIRE(ws.handler().calls == 0);
+    }
+
+    // the queued tasks may run after the socket is gone
+    REQUIRE(wait_until([&]{ return delivered.load() == 2; }));
+    dispatcher->stop();
+}
+
+TEST_CASE("WebSocket delivers messages in order on a dispatcher worker")
+{
+    auto conn = std::make_shared<DummyConnection>();
+    WebSocket ws(conn, "x", "80", "/");
+
+    auto dispatcher = std::make_shared<MessageDispatcher>();
+    ws.use_dispatcher(dispatcher);
+
+    std::mutex m;
+    std::vector<std::string> received;
+    std::thread::id handler_thread;
+    ws.on_message([&](const auto& msg) {
+        std::lock_guard<std::mutex> lk(m);
+        handler_thread = std::this_thread::get_id();
+        received.emplace_back(reinterpret_cast<const char*>(msg.data()), msg.size());
+    });
+
+    conn->trigger_connected();
+    conn->inject(bytes(switching_protocols));
+    conn->inject(text_frame("one"));
+    conn->inject(text_frame("two"));
+    conn->inject(text_frame("three"));
+
+    REQUIRE(wait_until([&]{ std::lock_guard<std::mutex> lk(m); return received.size() == 3; }));
+
+    std::lock_guard<std::mutex> lk(m);
+    REQUIRE(received == std::vector<std::string>{"one", "two", "three"});
+    REQUIRE(handler_thread != std::this_thread::get_id());
+    REQUIRE(dispatcher->stats().dispatched == 3);
+}
+
+TEST_CASE("WebSocket disconnects when the dispatch queue overflows")
+{
+    // outlives ws: queued handlers still read it until the dispatcher is stopped
+    std::atomic<bool> release{false};
+
+    auto conn = std::make_shared<DummyConnection>();
+    WebSocket ws(conn, "x", "80", "/");
+
+    DispatcherOptions opts;
+    opts.queue_capacity = 2;
+    opts.overflow = OverflowPolicy::Disconnect;
+    auto dispatcher = std::make_shared<MessageDispatcher>(opts);
+    ws.use_dispatcher(dispatcher);
+
+    // the first message blocks the only worker until the test releases it
+    ws.on_message([&](const auto&) {
+        while (!release.load()) std::this_thread::yield();
+    });
+
+    std::string error;
+    ws.on_error([&](const std::string& e) { error = e; });
+
+    conn->trigger_connected();
+    conn->inject(bytes(switching_protocols));
+    for (int i = 0; i < 4; ++i)
+        conn->inject(text_frame("slow"));
+
+    release = true;
+    dispatcher->stop();
+
+    REQUIRE(conn->closed);
+    REQUIRE(error == "Dispatch queue overflow");
+    REQUIRE(dispatcher->stats().rejected == 1);
+}
+
+TEST_CASE("WebSocket blocks the reader while the dispatch queue is full")
+{
+    std::atomic<bool> release{false};
+    std::atomic<int> handled{0};
+
+    auto conn = std::make_shared<DummyConnection>();
+    WebSocket ws(conn, "x", "80", "/");
+
+    DispatcherOptions opts;
+    opts.queue_capacity = 2;
+    opts.overflow = OverflowPolicy::Block;
+    auto dispatcher = std::make_shared<MessageDispatcher>(opts);
+    ws.use_dispatcher(dispatcher);
+
+    ws.on_message([&](const auto&) {
+        while (!release.load()) std::this_thread::yield();
+        ++handled;
+    });
+
+    conn->trigger_connected();
+    conn->inject(bytes(switching_protocols));
+
+    // one message in the handler, two queued, the rest has to wait for room
+    std::atomic<bool> reader_done{false};
+    std::thread reader([&]{
+        for (int i = 0; i < 6; ++i)
+            conn->inject(text_frame("slow"));
+        reader_done = true;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    bool blocked = !reader_done.load();
+
+    release = true;
+    reader.join();
+    bool all_handled = wait_until([&]{ return handled.load() == 6; });
+    dispatcher->stop();
+
+    REQUIRE(blocked);
+    REQUIRE(all_handled);
+    REQUIRE_FALSE(conn->closed);
+    REQUIRE(dispatcher->stats().dispatched == 6);
+}
+
+TEST_CASE("WebSocket destroyed by a worker while the reader is parked in push")
+{
+    std::atomic<bool> release{false};
+    std::atomic<int> handled{0};
+
+    auto conn = std::make_shared<DummyConnection>();
+    auto ws = std::make_shared<WebSocket>(conn, "x", "80", "/");
+
+    DispatcherOptions opts;
+    opts.queue_capacity = 2;
+    opts.overflow = OverflowPolicy::Block;
+    auto dispatcher = std::make_shared<MessageDispatcher>(opts);
+    ws->use_dispatcher(dispatcher);
+
+    // the first message drops the last reference to the socket, from the worker
+    ws->on_message([&](const auto&) {
+        if (handled++ > 0) return;
+        while (!release.load()) std::this_thread::yield();
+        ws.reset();
+    });
+
+    conn->trigger_connected();
+    conn->inject(bytes(switching_protocols));
+
+    std::atomic<bool> reader_done{false};
+    std::thread reader([&]{
+        for (int i = 0; i < 6; ++i)
+            conn->inject(text_frame("slow"));
+        reader_done = true;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    bool blocked = !reader_done.load();
+
+    // the destructor must neither wait for the parked reader nor pull the socket from under it
+    release = true;
+    bool finished = wait_until([&]{ return reader_done.load(); });
+    if (finished) reader.join();
+    else reader.detach();
+    dispatcher->stop();
+
+    REQUIRE(blocked);
+    REQUIRE(finished);
+    REQUIRE(ws == nullptr);
+}
+
+TEST_CASE("WebSocket destroyed from inside its own handler")
+{
+    auto conn = std::make_shared<DummyConnection>();
+    auto ws = std::make_shared<WebSocket>(conn, "x", "80", "/");
+
+    std::vector<std::string> received;
+    ws->on_message([&](const auto& msg) {
+        received.emplace_back(reinterpret_cast<const char*>(msg.data()), msg.size());
+        ws.reset();
+    });
+
+    conn->trigger_connected();
+
+    // the upgrade and two frames in one read: the socket goes away after the first
+    auto data = bytes(switching_protocols);
+    for (const char* m : {"one", "two"}) {
+        auto frame = text_frame(m);
+        data.insert(data.end(), frame.begin(), frame.end());
+    }
+    conn->inject(data);
+
+    REQUIRE(ws == nullptr);
+    REQUIRE(received == std::vector<std::string>{"one"});
+
+    conn->inject(text_frame("three"));
+    REQUIRE(received.size() == 1);
+}
+
+TEST_CASE("WebSocket handlers set before start() see the first events")
+{
+    // the io thread is already running, as in the client
+    Loopback loop;
+    loop.start();
+
+    std::atomic<bool> opened{false};
+    std::atomic<int> echoed{0};
+
+    auto ws = loop.add().ws;
+    WebSocket* raw = ws.get();
+
+    ws->on_open([&opened, raw]{
+        opened = true;
+        raw->send_text("first");
+    });
+    ws->on_message([&](const auto&) { ++echoed; });
+    ws->start();
+
+    bool done = wait_until([&]{ return echoed.load() == 1; });
+    loop.stop();
+
+    REQUIRE(done);
+    REQUIRE(opened.load());
+}
+
+TEST_CASE("WebSocket reports a socket that was never started")
+{
+    std::ostringstream err;
+    auto* old = std::cerr.rdbuf(err.rdbuf());
+    {
+        auto conn = std::make_shared<DummyConnection>();
+        WebSocket ws(conn, "x", "80", "/");
+        ws.on_open([]{});
+    }
+    {
+        // driven by its connection, as the unit tests do
+        auto conn = std::make_shared<DummyConnection>();
+        WebSocket ws(conn, "y", "80", "/");
+        conn->trigger_connected();
+    }
+    std::cerr.rdbuf(old);
+
+    REQUIRE(err.str().find("x:80/ destroyed without start()") != std::string::npos);
+    REQUIRE(err.str().find("y:80") == std::string::npos);
+}
+
+TEST_CASE("WebSocket echoes across a multi-threaded io_context")
+{
+    constexpr int messages_per_connection = 50;
+
+    for (int threads : {1, 2, 4}) {
+        for (int connections : {1, 8, 32}) {
+            Loopback loop;
+
+            const int expected = connections * messages_per_connection;
+            std::atomic<int> received{0};
+
+            for (int c = 0; c < connections; ++c) {
+                auto ws = loop.add().ws;
+                WebSocket* raw = ws.get();
+
+                ws->on_open([raw]{
+                    for (int i = 0; i < messages_per_connection; ++i)
+                        raw->send_text("msg " + std::to_string(i));
+                });
+                ws->on_message([&](const auto&) { ++received; });
+                ws->start();
+            }
+
+            bool done = loop.run([&]{ return received.load() == expected; }, threads);
+
+            INFO("threads=" << threads << " connections=" << connections);
+            REQUIRE(done);
+        }
+    }
+}
+
+TEST_CASE("WebSocket batches echo in order over loopback")
+{
+    constexpr int connections = 8;
+    constexpr int batches = 5;
+    constexpr int batch_size = 20;
+
+    Loopback loop;
+
+    std::mutex m;
+    std::vector<std::vector<std::string>> received(connections);
+    int complete = 0;
+
+    for (int c = 0; c < connections; ++c) {
+        auto ws = loop.add().ws;
+        WebSocket* raw = ws.get();
+
+        ws->on_open([raw]{
+            for (int b = 0; b < batches; ++b) {
+                std::vector<std::string> batch;
+                for (int i = 0; i < batch_size; ++i)
+                    batch.push_back("msg " + std::to_string(b * batch_size + i));
+                raw->send_batch(std::move(batch));
+            }
+        });
+        ws->on_message([&, c](const auto& msg) {
+            std::lock_guard<std::mutex> lk(m);
+            received[c].emplace_back(reinterpret_cast<const char*>(msg.data()), msg.size());
+            if (received[c].size() == batches * batch_size)
+                ++complete;
+        });
+        ws->start();
+    }
+
+    bool done = loop.run([&]{ std::lock_guard<std::mutex> lk(m); return complete == connections; }, 2);
+
+    REQUIRE(done);
+    for (const auto& r : received)
+        for (int i = 0; i < batches * batch_size; ++i)
+            REQUIRE(r[i] == "msg " + std::to_string(i));
+}
+
+TEST_CASE("Server-role batches wider than IOV_MAX echo over loopback")
+{
+    using ServerSocket = BasicWebSocket<FunctionHandlers, ServerRole>;
+
+    // twice as many buffers as one sendmsg takes, and more bytes than the socket buffer
+    const std::size_t count = max_gather_buffers;
+    const std::size_t size = 1000;
+
+    Loopback loop;
+
+    std::mutex m;
+    std::vector<std::vector<std::byte>> received;
+
+    auto ws = loop.add<ServerSocket>().ws;
+    ServerSocket* raw = ws.get();
+
+    ws->on_open([raw, count, size]{
+        std::vector<std::vector<std::byte>> batch;
+        for (std::size_t i = 0; i < count; ++i)
+            batch.emplace_back(size, std::byte(i & 0xff));
+        raw->send_batch(std::move(batch), ws_opcode::binary);
+    });
+    ws->on_binary([&](const auto& msg) {
+        std::lock_guard<std::mutex> lk(m);
+        received.push_back(msg);
+    });
+    ws->start();
+
+    bool done = loop.run([&]{ std::lock_guard<std::mutex> lk(m); return received.size() == count; });
+
+    REQUIRE(done);
+    for (std::size_t i = 0; i < count; ++i)
+        REQUIRE(received[i] == std::vector<std::byte>(size, std::byte(i & 0xff)));
+}
+
+TEST_CASE("WebSocket reads through a shared read buffer pool")
+{
+    constexpr int connections = 6;
+    constexpr int messages = 40;
+
+    Loopback loop;
+    // fewer slots than connections: the last two fall back to their own buffer
+    auto pool = std::make_shared<RegisteredReadBuffers>(loop.io, 4);
+
+    std::atomic<int> received{0};
+    std::atomic<int> mismatched{0};
+
+    for (int c = 0; c < connections; ++c) {
+        auto [conn, ws] = loop.add();
+        conn->use_read_buffers(pool);
+        WebSocket* raw = ws.get();
+
+        const std::string payload = "conn " + std::to_string(c);
+        ws->on_open([raw, payload]{
+            for (int i = 0; i < messages; ++i)
+                raw->send_text(payload);
+        });
+        ws->on_message([&, payload](const auto& msg) {
+            if (std::string(reinterpret_cast<const char*>(msg.data()), msg.size()) != payload)
+                ++mismatched;
+            ++received;
+        });
+        ws->start();
+    }
+    REQUIRE(pool->acquire() == -1);
+
+    bool done = loop.run([&]{ return received.load() == connections * messages; }, 2);
+
+    REQUIRE(done);
+    REQUIRE(mismatched.load() == 0);
+}
+
+TEST_CASE("TLS mode decides whether gather writes are flattened")
+{
+    // the kernel (or nobody) builds the records: batches go out as they are
+    REQUIRE(tls_mode_writes_raw(TlsMode::None));
+    REQUIRE(tls_mode_writes_raw(TlsMode::KtlsTx));
+    REQUIRE(tls_mode_writes_raw(TlsMode::Ktls));
+
+    // OpenSSL encrypts: one flattened buffer, one record
+    REQUIRE_FALSE(tls_mode_writes_raw(TlsMode::Userspace));
+    REQUIRE_FALSE(tls_mode_writes_raw(TlsMode::KtlsRx));
+
+    REQUIRE(std::string(tls_mode_name(TlsMode::None)) == "plain");
+    REQUIRE(std::string(tls_mode_name(TlsMode::Ktls)) == "ktls");
+}
+
+// open one socket, echo a text message and a batch, report the negotiated mode;
+// with a server TLS context the loopback speaks wss:// and the client trusts it
+static TlsMode echo_with_options(const SocketOptions& opts, asio::ssl::context* tls = nullptr)
+{
+    Loopback loop(tls);
+    auto [conn, ws] = loop.add(opts);
+    if (tls) trust_test_certificate(*conn);
+    WebSocket* raw = ws.get();
+
+    std::mutex m;
+    std::vector<std::string> received;
+    std::atomic<bool> opened{false};
+
+    ws->on_open([&opened, raw]{
+        opened = true;
+        raw->send_text("single");
+        raw->send_batch(std::vector<std::string>{"batch 0", std::string(5000, 'b'), "batch 2"});
+    });
+    ws->on_message([&](const auto& msg) {
+        std::lock_guard<std::mutex> lk(m);
+        received.emplace_back(reinterpret_cast<const char*>(msg.data()), msg.size());
+    });
+    ws->start();
+
+    bool done = loop.run([&]{ std::lock_guard<std::mutex> lk(m); return received.size() == 4; });
+
+    REQUIRE(done);
+    REQUIRE(opened.load());
+    REQUIRE(received == std::vector<std::string>{"single", "batch 0", std::string(5000, 'b'), "batch 2"});
+    return conn->tls_mode();
+}
+
+TEST_CASE("TcpConnection reports plain TCP, also when kTLS meets a plain server")
+{
+    for (bool ktls : {false, true}) {
+        SocketOptions opts;
+        opts.ktls = ktls;
+
+        // the TLS handshake is refused, both TLS paths fall back to plain TCP
+        INFO("ktls=" << ktls);
+        REQUIRE(echo_with_options(opts) == TlsMode::None);
+    }
+}
+
+TEST_CASE("wss:// echoes through asio TLS and the kTLS path")
+{
+    asio::ssl::context tls(asio::ssl::context::tls_server);
+    use_test_certificate(tls);
+
+    SocketOptions userspace;
+    REQUIRE(echo_with_options(userspace, &tls) == TlsMode::Userspace);
+
+    // without the kernel's `tls` module this is the userspace fallback on the native SSL
+    SocketOptions offload;
+    offload.ktls = true;
+    TlsMode mode = echo_with_options(offload, &tls);
+    INFO("mode=" << tls_mode_name(mode));
+    REQUIRE(mode != TlsMode::None);
+}
+
+TEST_CASE("wss:// kTLS path reads a burst of records in order")
+{
+    asio::ssl::context tls(asio::ssl::context::tls_server);
+    use_test_certificate(tls);
+
+    SocketOptions opts;
+    opts.ktls = true;
+    Loopback loop(&tls);
+    auto [conn, ws] = loop.add(opts);
+    trust_test_certificate(*conn);
+    WebSocket* raw = ws.get();
+
+    // far more echoes than native_read hands out per strand turn
+    const int count = 200;
+    std::mutex m;
+    std::vector<std::string> received;
+    ws->on_open([raw]{
+        for (int i = 0; i < count; ++i) raw->send_text("burst " + std::to_string(i));
+    });
+    ws->on_message([&](const auto& msg) {
+        std::lock_guard<std::mutex> lk(m);
+        received.emplace_back(reinterpret_cast<const char*>(msg.data()), msg.size());
+    });
+    ws->start();
+
+    bool done = loop.run([&]{ std::lock_guard<std::mutex> lk(m); return received.size() == count; });
+
+    REQUIRE(done);
+    for (int i = 0; i < count; ++i) REQUIRE(received[i] == "burst " + std::to_string(i));
+}
+
+TEST_CASE("wss:// reports a peer that resets the connection")
+{
+    asio::io_context io;
+    asio::ssl::context tls(asio::ssl::context::tls_server);
+    use_test_certificate(tls);
+
+    // completes the TLS handshake, then aborts the connection with a RST
+    tcp::acceptor acceptor(io, tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+    const std::string port = std::to_string(acceptor.local_endpoint().port());
+    std::unique_ptr<asio::ssl::stream<tcp::socket>> peer;
+
+    std::function<void()> accept = [&]{
+        acceptor.async_accept([&](const asio::error_code& ec, tcp::socket socket) {
+            if (ec) return;
+            peer = std::make_unique<asio::ssl::stream<tcp::socket>>(std::move(socket), tls);
+            peer->async_handshake(asio::ssl::stream_base::server, [&](const asio::error_code& ec) {
+                if (ec) return;
+                asio::error_code ignored;
+                peer->next_layer().set_option(asio::socket_base::linger(true, 0), ignored);
+                peer->next_layer().close(ignored);
+                accept();
+            });
+        });
+    };
+    accept();
+
+    for (bool ktls : {false, true}) {
+        SocketOptions opts;
+        opts.ktls = ktls;
+
+        auto conn = std::make_shared<TcpConnection>(io, "127.0.0.1", port, opts);
+        trust_test_certificate(*conn);
+        auto ws = std::make_shared<WebSocket>(conn, "127.0.0.1", port, "/");
+
+        // replaces the WebSocket's logging handler, before start()
+        std::mutex m;
+        asio::error_code error;
+        conn->on_error([&](const asio::error_code& ec) {
+            std::lock_guard<std::mutex> lk(m);
+            error = ec;
+        });
+        ws->start();
+
+        auto work = asio::make_work_guard(io);
+        std::thread io_thread([&io]{ io.run(); });
+        bool reported = wait_until([&]{ std::lock_guard<std::mutex> lk(m); return bool(error); });
+        io.stop();
+        io_thread.join();
+        io.restart();
+
+        INFO("ktls=" << ktls << " error=" << error.message());
+        REQUIRE(reported);
+        REQUIRE(error != asio::error::eof);
+    }
+}